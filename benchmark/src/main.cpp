@@ -0,0 +1,397 @@
+#include "ofMain.h"
+#include "ofxFFmpegRecorder.h"
+
+#include <map>
+
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Drives ofxFFmpegRecorder::addFrame() with synthetic frames and prints the results as JSON so that they can be compared between
+ * builds. Every combination of the given resolutions, pixel formats and frame rates is run for the given duration.
+ *
+ * Usage: benchmark [--resolutions 720p,1080p,4k] [--formats rgb,gray] [--fps 30,60] [--seconds 5] [--codec rawvideo]
+ *                  [--sink null|devnull|stub] [--stub-command "cat > /dev/null"] [--ffmpeg path] [--output results.json]
+ *                  [--compress-queue threshold] [--memory-budget megabytes]
+ *                  [--chunked-processes 0] [--chunk-frames 120] [--offline-frames 600] [--offline-output benchmark_offline.mkv]
+ *
+ * Sinks:
+ *     null    ffmpeg encodes the frames with --codec and discards them with "-f null".
+ *     devnull The frames are written to /dev/null with ofxFFmpegRawFileSink, so only the capture pipeline is measured.
+ *     stub    The frames are piped to --stub-command.
+ *
+ * --compress-queue enables ofxFFmpegRecorder::setCompressingQueuedFrames() with the given threshold, 0 disables it.
+ * --memory-budget sets ofxFFmpegRecorder::setQueueMemoryBudget(), 0 disables it.
+ *
+ * If --chunked-processes is more than 1, each configuration also encodes --offline-frames frames with --codec in the offline mode,
+ * once with a single ffmpeg process and once with ofxFFmpegRecorder::setChunkedEncoding(), and reports both times and the speedup.
+ * Use a real encoder such as libx264 for this, the output file is deleted afterwards.
+ *
+ * On Linux and macOS each configuration runs in its own child process, so max_resident_kb is the peak memory of that configuration
+ * rather than the largest peak of all the configurations before it.
+ */
+
+struct BenchmarkConfig {
+    std::string resolution;
+    glm::vec2 size;
+    ofImageType format;
+    float fps;
+};
+
+struct BenchmarkResult {
+    BenchmarkConfig config;
+    double seconds = 0;
+    uint64_t addFrameCalls = 0;
+    double addFrameMeanMicros = 0;
+    double enqueueP50Micros = 0, enqueueP99Micros = 0, enqueueP999Micros = 0;
+    double stopSeconds = 0;
+    double framesPerSecond = 0, bytesPerSecond = 0;
+    ofxFFmpegRecorderStats stats;
+    long maxResidentKiloBytes = 0;
+    double offlineSingleSeconds = 0, offlineChunkedSeconds = 0;
+};
+
+static std::map<std::string, std::string> parseArguments(int argc, char *argv[])
+{
+    std::map<std::string, std::string> arguments = {
+        {"resolutions", "720p,1080p,4k"},
+        {"formats", "rgb,gray"},
+        {"fps", "30,60"},
+        {"seconds", "5"},
+        {"codec", "rawvideo"},
+        {"sink", "null"},
+        {"stub-command", "cat > /dev/null"},
+        {"ffmpeg", "ffmpeg"},
+        {"output", ""},
+        {"compress-queue", "0"},
+        {"memory-budget", "0"},
+        {"chunked-processes", "0"},
+        {"chunk-frames", "120"},
+        {"offline-frames", "600"},
+        {"offline-output", "benchmark_offline.mkv"},
+    };
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string key = argv[i];
+        if (key.find("--") == 0) {
+            arguments[key.substr(2)] = argv[i + 1];
+        }
+    }
+
+    return arguments;
+}
+
+static glm::vec2 getResolutionSize(const std::string &resolution)
+{
+    if (resolution == "4k") {
+        return glm::vec2(3840, 2160);
+    }
+    else if (resolution == "1080p") {
+        return glm::vec2(1920, 1080);
+    }
+
+    return glm::vec2(1280, 720);
+}
+
+static double getPercentile(std::vector<double> &values, double percentile)
+{
+    if (values.empty()) {
+        return 0;
+    }
+
+    const size_t index = std::min(values.size() - 1, static_cast<size_t>(percentile * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+static long getMaxResidentKiloBytes()
+{
+#if defined(_WIN32)
+    return 0;
+#else
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+static BenchmarkResult runBenchmark(const BenchmarkConfig &config, std::map<std::string, std::string> &arguments)
+{
+    BenchmarkResult result;
+    result.config = config;
+
+    // A few different frames so that the content changes between the added frames.
+    std::vector<ofPixels> frames(4);
+    for (size_t i = 0; i < frames.size(); i++) {
+        frames[i].allocate(config.size.x, config.size.y, config.format);
+        unsigned char *data = frames[i].getData();
+        for (size_t j = 0; j < frames[i].getTotalBytes(); j++) {
+            data[j] = static_cast<unsigned char>(j * (i + 1));
+        }
+    }
+
+    ofxFFmpegRecorder recorder;
+    recorder.setup(true, false, config.size, config.fps);
+    // The pixel format and the codec are checked against this binary, so it is set first.
+    recorder.setFFmpegPath(arguments["ffmpeg"]);
+    recorder.setPixelFormat(config.format);
+    recorder.setVideoCodec(arguments["codec"]);
+    recorder.setOverWrite(true);
+
+    const int compressionThreshold = ofToInt(arguments["compress-queue"]);
+    recorder.setCompressingQueuedFrames(compressionThreshold > 0, compressionThreshold > 0 ? compressionThreshold : 4);
+    recorder.setQueueMemoryBudget(static_cast<size_t>(ofToDouble(arguments["memory-budget"]) * 1024 * 1024));
+
+    const std::string sink = arguments["sink"];
+    bool isStarted = false;
+    if (sink == "devnull") {
+        isStarted = recorder.startCustomRecord(std::make_shared<ofxFFmpegRawFileSink>("/dev/null"));
+    }
+    else if (sink == "stub") {
+        // The recorder appends its arguments to the command, they become the unused positional parameters of the script.
+        recorder.setFFmpegPath("sh -c '" + arguments["stub-command"] + "' sh");
+        recorder.setOutputPath("-");
+        isStarted = recorder.startCustomRecord();
+    }
+    else {
+        recorder.addAdditionalOutputArgument("-f null");
+        recorder.setOutputPath("-");
+        isStarted = recorder.startCustomRecord();
+    }
+
+    if (isStarted == false) {
+        return result;
+    }
+
+    std::vector<double> latencies;
+    const double duration = ofToDouble(arguments["seconds"]);
+    const auto framePeriod = std::chrono::duration<double>(1.0 / config.fps);
+    const auto start = std::chrono::high_resolution_clock::now();
+    auto nextFrame = start;
+    double totalMicros = 0;
+
+    while (std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count() < duration) {
+        const auto before = std::chrono::high_resolution_clock::now();
+        recorder.addFrame(frames[latencies.size() % frames.size()]);
+        const double micros = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - before).count();
+        latencies.push_back(micros);
+        totalMicros += micros;
+
+        // Simulate the render loop of an application that runs at the recording fps.
+        nextFrame += std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(framePeriod);
+        std::this_thread::sleep_until(nextFrame);
+    }
+
+    result.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    result.stats = recorder.getStats();
+
+    const auto stopStart = std::chrono::high_resolution_clock::now();
+    recorder.stop();
+    result.stopSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - stopStart).count();
+
+    result.addFrameCalls = latencies.size();
+    result.addFrameMeanMicros = latencies.empty() ? 0 : totalMicros / latencies.size();
+    result.enqueueP50Micros = getPercentile(latencies, 0.5);
+    result.enqueueP99Micros = getPercentile(latencies, 0.99);
+    result.enqueueP999Micros = getPercentile(latencies, 0.999);
+    result.framesPerSecond = result.stats.writtenFrames / result.seconds;
+    result.bytesPerSecond = result.stats.writtenBytes / result.seconds;
+    result.maxResidentKiloBytes = getMaxResidentKiloBytes();
+    return result;
+}
+
+/**
+ * @brief Encodes the frames as fast as possible in the offline mode and returns the time from the first frame until stop() returns.
+ */
+static double runOfflineEncode(const BenchmarkConfig &config, std::map<std::string, std::string> &arguments, size_t processCount)
+{
+    std::vector<ofPixels> frames(4);
+    for (size_t i = 0; i < frames.size(); i++) {
+        frames[i].allocate(config.size.x, config.size.y, config.format);
+        unsigned char *data = frames[i].getData();
+        for (size_t j = 0; j < frames[i].getTotalBytes(); j++) {
+            data[j] = static_cast<unsigned char>(j * (i + 1));
+        }
+    }
+
+    ofxFFmpegRecorder recorder;
+    recorder.setup(true, false, config.size, config.fps);
+    recorder.setFFmpegPath(arguments["ffmpeg"]);
+    recorder.setPixelFormat(config.format);
+    recorder.setVideoCodec(arguments["codec"]);
+    recorder.setOverWrite(true);
+    recorder.setOutputPath(arguments["offline-output"]);
+    recorder.setOffline(true);
+    recorder.setChunkedEncoding(processCount, ofToInt(arguments["chunk-frames"]));
+    if (recorder.startCustomRecord() == false) {
+        return 0;
+    }
+
+    const size_t frameCount = ofToInt(arguments["offline-frames"]);
+    const auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < frameCount; i++) {
+        recorder.addFrame(frames[i % frames.size()]);
+    }
+
+    recorder.stop();
+    const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    ofFile::removeFile(arguments["offline-output"], false);
+    return seconds;
+}
+
+static std::string toJson(const BenchmarkResult &result)
+{
+    std::stringstream json;
+    json << "{\"resolution\": \"" << result.config.resolution << "\""
+         << ", \"width\": " << result.config.size.x
+         << ", \"height\": " << result.config.size.y
+         << ", \"format\": \"" << (result.config.format == OF_IMAGE_GRAYSCALE ? "gray" : "rgb") << "\""
+         << ", \"fps\": " << result.config.fps
+         << ", \"seconds\": " << result.seconds
+         << ", \"add_frame_calls\": " << result.addFrameCalls
+         << ", \"add_frame_mean_us\": " << result.addFrameMeanMicros
+         << ", \"enqueue_p50_us\": " << result.enqueueP50Micros
+         << ", \"enqueue_p99_us\": " << result.enqueueP99Micros
+         << ", \"enqueue_p999_us\": " << result.enqueueP999Micros
+         << ", \"written_frames_per_second\": " << result.framesPerSecond
+         << ", \"written_bytes_per_second\": " << result.bytesPerSecond
+         << ", \"duplicated_frames\": " << result.stats.duplicatedFrames
+         << ", \"dropped_frames\": " << result.stats.droppedFrames
+         << ", \"static_frames\": " << result.stats.staticFrames
+         << ", \"unwritten_frames\": " << result.stats.unwrittenFrames
+         << ", \"max_queued_frames\": " << result.stats.maxQueuedFrames
+         << ", \"max_queued_bytes\": " << result.stats.maxQueuedBytes
+         << ", \"compressed_frames\": " << result.stats.compressedFrames
+         << ", \"compression_saved_bytes\": " << result.stats.compressionSavedBytes
+         << ", \"spilled_frames\": " << result.stats.spilledFrames
+         << ", \"pool_allocated_frames\": " << result.stats.poolAllocatedFrames
+         << ", \"encoder_speed\": " << result.stats.encoderSpeed
+         << ", \"stop_seconds\": " << result.stopSeconds
+         << ", \"max_resident_kb\": " << result.maxResidentKiloBytes;
+    if (result.offlineChunkedSeconds > 0) {
+        json << ", \"offline_single_seconds\": " << result.offlineSingleSeconds
+             << ", \"offline_chunked_seconds\": " << result.offlineChunkedSeconds
+             << ", \"chunked_speedup\": " << result.offlineSingleSeconds / result.offlineChunkedSeconds;
+    }
+
+    json << "}";
+    return json.str();
+}
+
+static std::string runConfig(const BenchmarkConfig &config, std::map<std::string, std::string> &arguments)
+{
+    BenchmarkResult result = runBenchmark(config, arguments);
+    const size_t processCount = ofToInt(arguments["chunked-processes"]);
+    if (processCount > 1) {
+        result.offlineSingleSeconds = runOfflineEncode(config, arguments, 1);
+        result.offlineChunkedSeconds = runOfflineEncode(config, arguments, processCount);
+    }
+
+    return toJson(result);
+}
+
+#if !defined(_WIN32)
+/**
+ * @brief Runs the configuration in a child process and returns its JSON. The peak resident memory of a process never goes down, so
+ * this keeps each configuration from reporting the peak of the ones before it.
+ */
+static std::string runConfigInChild(const BenchmarkConfig &config, std::map<std::string, std::string> &arguments)
+{
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return runConfig(config, arguments);
+    }
+
+    const pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return runConfig(config, arguments);
+    }
+
+    if (pid == 0) {
+        close(fds[0]);
+        const std::string json = runConfig(config, arguments);
+        size_t offset = 0;
+        while (offset < json.size()) {
+            const ssize_t written = write(fds[1], json.data() + offset, json.size() - offset);
+            if (written <= 0) {
+                break;
+            }
+
+            offset += written;
+        }
+
+        close(fds[1]);
+        _exit(0);
+    }
+
+    close(fds[1]);
+    std::string json;
+    char buffer[4096];
+    ssize_t count = 0;
+    while ((count = read(fds[0], buffer, sizeof(buffer))) > 0) {
+        json.append(buffer, count);
+    }
+
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (json.empty()) {
+        std::stringstream error;
+        error << "{\"resolution\": \"" << config.resolution << "\""
+              << ", \"format\": \"" << (config.format == OF_IMAGE_GRAYSCALE ? "gray" : "rgb") << "\""
+              << ", \"fps\": " << config.fps
+              << ", \"error\": \"The benchmark process exited with status " << status << ".\"}";
+        return error.str();
+    }
+
+    return json;
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+    std::map<std::string, std::string> arguments = parseArguments(argc, argv);
+
+    std::vector<BenchmarkConfig> configs;
+    for (const std::string &resolution : ofSplitString(arguments["resolutions"], ",", true, true)) {
+        for (const std::string &format : ofSplitString(arguments["formats"], ",", true, true)) {
+            for (const std::string &fps : ofSplitString(arguments["fps"], ",", true, true)) {
+                BenchmarkConfig config;
+                config.resolution = resolution;
+                config.size = getResolutionSize(resolution);
+                config.format = format == "gray" ? OF_IMAGE_GRAYSCALE : OF_IMAGE_COLOR;
+                config.fps = ofToFloat(fps);
+                configs.push_back(config);
+            }
+        }
+    }
+
+    std::string json = "[\n";
+    for (size_t i = 0; i < configs.size(); i++) {
+#if defined(_WIN32)
+        const std::string result = runConfig(configs[i], arguments);
+#else
+        const std::string result = runConfigInChild(configs[i], arguments);
+#endif
+        json += "    " + result + (i + 1 < configs.size() ? ",\n" : "\n");
+    }
+
+    json += "]\n";
+
+    std::cout << json;
+    if (arguments["output"].length() > 0) {
+        std::ofstream file(arguments["output"]);
+        file << json;
+    }
+
+    return 0;
+}
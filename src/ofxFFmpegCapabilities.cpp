@@ -0,0 +1,516 @@
+#include "ofxFFmpegCapabilities.h"
+// openFrameworks
+#include "ofLog.h"
+#include "ofFileUtils.h"
+#include "ofUtils.h"
+
+#include "ofxFFmpegProcess.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if !defined(_WIN32)
+#include <signal.h>
+#include <sys/wait.h>
+#endif
+
+// Logging macros
+#define LOG_ERROR(message) ofLogError("") << __FUNCTION__ << ":" << __LINE__ << ": " << message
+#define LOG_WARNING(message) ofLogWarning("") << __FUNCTION__ << ":" << __LINE__ << ": " << message
+
+namespace
+{
+
+// Increase this when the cache file changes, so the old files are probed again.
+const int CACHE_VERSION = 1;
+
+// A test encode with a broken driver can hang, it is killed after this many seconds.
+const int HARDWARE_TEST_TIMEOUT = 10;
+
+struct EncoderFamily {
+    std::string name;
+
+    /**
+     * @brief From the fastest to the slowest. The hardware encoders are tested before they are used.
+     */
+    std::vector<std::string> hardwareEncoders, softwareEncoders;
+};
+
+const std::vector<EncoderFamily> &getEncoderFamilies()
+{
+    // VAAPI is left out because it needs a device and an upload filter.
+    static const std::vector<EncoderFamily> families = {
+        {"h264", {"h264_nvenc", "h264_videotoolbox", "h264_qsv", "h264_amf"}, {"libx264", "libopenh264"}},
+        {"hevc", {"hevc_nvenc", "hevc_videotoolbox", "hevc_qsv", "hevc_amf"}, {"libx265"}},
+        {"av1", {"av1_nvenc", "av1_qsv", "av1_amf"}, {"libsvtav1", "librav1e", "libaom-av1"}},
+        {"vp9", {"vp9_qsv"}, {"libvpx-vp9"}},
+        {"vp8", {}, {"libvpx"}},
+        {"mpeg4", {}, {"mpeg4", "libxvid"}},
+        {"prores", {"prores_videotoolbox"}, {"prores_ks", "prores"}}
+    };
+
+    return families;
+}
+
+#if defined(_WIN32)
+const char PATH_SEPARATOR = ';';
+const std::string NULL_DEVICE = "NUL";
+#else
+const char PATH_SEPARATOR = ':';
+const std::string NULL_DEVICE = "/dev/null";
+#endif
+
+/**
+ * @brief Runs the command and returns its exit code. The lines that it writes to stdout are added to lines if it is not null. If timeout
+ * is more than 0, the command is killed after that many seconds and -1 is returned. The timeout is not supported on Windows.
+ */
+int runCommand(const std::string &command, std::vector<std::string> *lines, int timeout = 0)
+{
+#if defined(_WIN32)
+    (void)timeout;
+    FILE *file = _popen(command.c_str(), "r");
+#else
+    // The shell prints its pid before it is replaced with the command, so that the command can be killed.
+    FILE *file = ofxFFmpegOpenProcess(timeout > 0 ? "echo $$; exec " + command : command, "r");
+#endif
+
+    if (file == nullptr) {
+        return -1;
+    }
+
+#if !defined(_WIN32)
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool isFinished = false;
+    std::thread watchdog;
+    if (timeout > 0) {
+        int process = -1;
+        if (fscanf(file, "%d", &process) != 1 || fgetc(file) != '\n') {
+            pclose(file);
+            return -1;
+        }
+
+        watchdog = std::thread([&mutex, &condition, &isFinished, process, timeout]() {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (condition.wait_for(lock, std::chrono::seconds(timeout), [&isFinished]() { return isFinished; }) == false) {
+                kill(process, SIGKILL);
+            }
+        });
+    }
+#endif
+
+    char line[512];
+    while (fgets(line, sizeof(line), file)) {
+        if (lines) {
+            std::string entry(line);
+            while (entry.empty() == false && (entry.back() == '\n' || entry.back() == '\r')) {
+                entry.pop_back();
+            }
+
+            lines->push_back(entry);
+        }
+    }
+
+#if defined(_WIN32)
+    return _pclose(file);
+#else
+    const int status = pclose(file);
+    if (watchdog.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            isFinished = true;
+        }
+
+        condition.notify_one();
+        watchdog.join();
+    }
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+#endif
+}
+
+/**
+ * @brief Returns the modification time of the file in seconds, or -1 if it does not exist.
+ */
+int64_t getModifiedTime(const std::string &path)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        return -1;
+    }
+
+    return static_cast<int64_t>(info.st_mtime);
+}
+
+/**
+ * @brief Returns the path of the binary that the shell runs for ffmpegPath, or an empty string if it is not found.
+ */
+std::string resolveBinaryPath(const std::string &ffmpegPath)
+{
+    if (ffmpegPath.find('/') != std::string::npos || ffmpegPath.find('\\') != std::string::npos) {
+        if (getModifiedTime(ffmpegPath) >= 0) {
+            return ofFilePath::getAbsolutePath(ffmpegPath, false);
+        }
+#if defined(_WIN32)
+        if (getModifiedTime(ffmpegPath + ".exe") >= 0) {
+            return ofFilePath::getAbsolutePath(ffmpegPath + ".exe", false);
+        }
+#endif
+        return "";
+    }
+
+    const char *environment = std::getenv("PATH");
+    std::stringstream paths(environment ? environment : "");
+    std::string directory;
+    while (std::getline(paths, directory, PATH_SEPARATOR)) {
+        if (directory.empty()) {
+            continue;
+        }
+
+        std::string path = ofFilePath::join(directory, ffmpegPath);
+#if defined(_WIN32)
+        if (ofFilePath::getFileExt(path).empty()) {
+            path += ".exe";
+        }
+#endif
+        if (getModifiedTime(path) >= 0) {
+            return path;
+        }
+    }
+
+    return "";
+}
+
+std::string getDefaultCacheDirectory()
+{
+#if defined(_WIN32)
+    const char *directory = std::getenv("LOCALAPPDATA");
+    if (directory) {
+        return ofFilePath::join(directory, "ofxFFmpegRecorder");
+    }
+#elif defined(__APPLE__)
+    return ofFilePath::join(ofFilePath::getUserHomeDir(), "Library/Caches/ofxFFmpegRecorder");
+#else
+    const char *directory = std::getenv("XDG_CACHE_HOME");
+    if (directory && directory[0] != '\0') {
+        return ofFilePath::join(directory, "ofxFFmpegRecorder");
+    }
+
+    return ofFilePath::join(ofFilePath::getUserHomeDir(), ".cache/ofxFFmpegRecorder");
+#endif
+    return ofToDataPath("ofxFFmpegRecorder", true);
+}
+
+/**
+ * @brief Returns the line after the separator line of a listing, e.g. "------" after the legend of "-encoders".
+ */
+size_t getListingStart(const std::vector<std::string> &lines, const std::string &separator)
+{
+    for (size_t index = 0; index < lines.size(); index++) {
+        if (lines[index].find(separator) != std::string::npos && lines[index].find_first_not_of(" -") == std::string::npos) {
+            return index + 1;
+        }
+    }
+
+    return lines.size();
+}
+
+}
+
+ofxFFmpegCapabilities::ofxFFmpegCapabilities()
+    : m_IsValid(false)
+{
+
+}
+
+std::shared_ptr<const ofxFFmpegCapabilities> ofxFFmpegCapabilities::probe(const std::string &ffmpegPath, const std::string &cacheDirectory)
+{
+    return get(ffmpegPath, cacheDirectory, true);
+}
+
+std::shared_ptr<const ofxFFmpegCapabilities> ofxFFmpegCapabilities::find(const std::string &ffmpegPath, const std::string &cacheDirectory)
+{
+    return get(ffmpegPath, cacheDirectory, false);
+}
+
+std::shared_ptr<const ofxFFmpegCapabilities> ofxFFmpegCapabilities::get(const std::string &ffmpegPath, const std::string &cacheDirectory,
+                                                                         bool isProbing)
+{
+    // Probing the same binary from many recorders at once would run it many times. find() only takes the lock of the map, so it does
+    // not wait for a probe.
+    static std::mutex probeMutex, probedMutex;
+    static std::map<std::string, std::shared_ptr<const ofxFFmpegCapabilities>> probed;
+    std::unique_lock<std::mutex> probeLock(probeMutex, std::defer_lock);
+    if (isProbing) {
+        probeLock.lock();
+    }
+
+    const std::string binaryPath = resolveBinaryPath(ffmpegPath);
+    const int64_t modifiedTime = binaryPath.empty() ? -1 : getModifiedTime(binaryPath);
+    const std::string key = (binaryPath.empty() ? ffmpegPath : binaryPath) + "@" + std::to_string(modifiedTime);
+    {
+        std::lock_guard<std::mutex> lock(probedMutex);
+        auto found = probed.find(key);
+        if (found != probed.end()) {
+            return found->second;
+        }
+    }
+
+    std::shared_ptr<ofxFFmpegCapabilities> capabilities = std::make_shared<ofxFFmpegCapabilities>();
+    if (binaryPath.empty()) {
+        // It may still run through the shell, e.g. as an alias, but it cannot be cached without a file.
+        if (isProbing == false) {
+            return nullptr;
+        }
+
+        capabilities->probeBinary(ffmpegPath);
+    }
+    else {
+        const std::string directory = cacheDirectory.empty() ? getDefaultCacheDirectory() : cacheDirectory;
+        const std::string cachePath = ofFilePath::join(directory, "capabilities_" + std::to_string(std::hash<std::string>()(binaryPath)) +
+                                                       ".txt");
+        if (capabilities->load(cachePath, binaryPath, modifiedTime) == false) {
+            if (isProbing == false) {
+                return nullptr;
+            }
+
+            capabilities->probeBinary(ffmpegPath);
+            if (capabilities->isValid()) {
+                if (ofDirectory::doesDirectoryExist(directory, false) || ofDirectory::createDirectory(directory, false, true)) {
+                    capabilities->save(cachePath, binaryPath, modifiedTime);
+                }
+                else {
+                    LOG_WARNING("Cannot create " + directory + ". The capabilities are not cached.");
+                }
+            }
+        }
+    }
+
+    if (capabilities->isValid() == false) {
+        LOG_ERROR("Cannot run " + ffmpegPath + " to probe its capabilities.");
+    }
+
+    std::lock_guard<std::mutex> lock(probedMutex);
+    probed[key] = capabilities;
+    return capabilities;
+}
+
+bool ofxFFmpegCapabilities::isValid() const
+{
+    return m_IsValid;
+}
+
+const std::string &ofxFFmpegCapabilities::getVersion() const
+{
+    return m_Version;
+}
+
+bool ofxFFmpegCapabilities::hasEncoder(const std::string &name) const
+{
+    return m_Encoders.count(name) > 0;
+}
+
+bool ofxFFmpegCapabilities::hasMuxer(const std::string &name) const
+{
+    return m_Muxers.count(name) > 0;
+}
+
+bool ofxFFmpegCapabilities::hasPixelFormat(const std::string &name) const
+{
+    return m_PixelFormats.count(name) > 0;
+}
+
+const std::set<std::string> &ofxFFmpegCapabilities::getEncoders() const
+{
+    return m_Encoders;
+}
+
+const std::set<std::string> &ofxFFmpegCapabilities::getMuxers() const
+{
+    return m_Muxers;
+}
+
+const std::set<std::string> &ofxFFmpegCapabilities::getPixelFormats() const
+{
+    return m_PixelFormats;
+}
+
+std::string ofxFFmpegCapabilities::getFastestEncoder(const std::string &family) const
+{
+    auto found = m_FastestEncoders.find(family);
+    return found == m_FastestEncoders.end() ? "" : found->second;
+}
+
+void ofxFFmpegCapabilities::probeBinary(const std::string &ffmpegPath)
+{
+    const std::string command = ffmpegPath + " -hide_banner ";
+    std::vector<std::string> lines;
+    if (runCommand(ffmpegPath + " -version", &lines) != 0 || lines.empty()) {
+        return;
+    }
+
+    // "ffmpeg version 6.1.1 Copyright (c) ..."
+    std::vector<std::string> tokens = ofSplitString(lines.front(), " ", true, true);
+    m_Version = tokens.size() > 2 ? tokens[2] : lines.front();
+
+    // " V....D libx264              libx264 H.264 / AVC / MPEG-4 AVC / MPEG-4 part 10 (codec h264)"
+    lines.clear();
+    runCommand(command + "-encoders", &lines);
+    for (size_t index = getListingStart(lines, "------"); index < lines.size(); index++) {
+        tokens = ofSplitString(lines[index], " ", true, true);
+        if (tokens.size() > 1) {
+            m_Encoders.insert(tokens[1]);
+        }
+    }
+
+    // "  E mp4             MP4 (MPEG-4 Part 14)"
+    lines.clear();
+    runCommand(command + "-muxers", &lines);
+    for (size_t index = getListingStart(lines, "--"); index < lines.size(); index++) {
+        tokens = ofSplitString(lines[index], " ", true, true);
+        if (tokens.size() > 1 && tokens[0].find('E') != std::string::npos) {
+            for (const std::string &name : ofSplitString(tokens[1], ",", true, true)) {
+                m_Muxers.insert(name);
+            }
+        }
+    }
+
+    // "IO... rgb24                  3             24      8-8-8"
+    lines.clear();
+    runCommand(command + "-pix_fmts", &lines);
+    for (size_t index = getListingStart(lines, "-----"); index < lines.size(); index++) {
+        tokens = ofSplitString(lines[index], " ", true, true);
+        if (tokens.size() > 1 && tokens[0].size() == 5 && tokens[0][0] == 'I') {
+            m_PixelFormats.insert(tokens[1]);
+        }
+    }
+
+    // A hardware encoder is often built in even if the machine has no such hardware or driver, so it has to encode a few frames.
+    for (const EncoderFamily &family : getEncoderFamilies()) {
+        for (const std::string &encoder : family.hardwareEncoders) {
+            if (hasEncoder(encoder) == false) {
+                continue;
+            }
+
+            const std::string test = command + "-loglevel quiet -f lavfi -i color=c=black:s=256x256:r=30 -frames:v 3 -c:v " + encoder +
+                                     " -f null - > " + NULL_DEVICE + " 2>&1";
+            if (runCommand(test, nullptr, HARDWARE_TEST_TIMEOUT) == 0) {
+                m_FastestEncoders[family.name] = encoder;
+                break;
+            }
+        }
+
+        if (m_FastestEncoders.count(family.name) > 0) {
+            continue;
+        }
+
+        for (const std::string &encoder : family.softwareEncoders) {
+            if (hasEncoder(encoder)) {
+                m_FastestEncoders[family.name] = encoder;
+                break;
+            }
+        }
+    }
+
+    m_IsValid = m_Encoders.empty() == false;
+}
+
+bool ofxFFmpegCapabilities::load(const std::string &cachePath, const std::string &binaryPath, int64_t modifiedTime)
+{
+    std::ifstream file(cachePath);
+    if (file.is_open() == false) {
+        return false;
+    }
+
+    std::map<std::string, std::string> header;
+    std::string line;
+    while (std::getline(file, line)) {
+        const size_t separator = line.find('=');
+        if (separator == std::string::npos) {
+            continue;
+        }
+
+        const std::string key = line.substr(0, separator);
+        const std::string value = line.substr(separator + 1);
+        if (key == "encoder") {
+            m_Encoders.insert(value);
+        }
+        else if (key == "muxer") {
+            m_Muxers.insert(value);
+        }
+        else if (key == "pixel_format") {
+            m_PixelFormats.insert(value);
+        }
+        else if (key == "fastest") {
+            const size_t colon = value.find(':');
+            if (colon != std::string::npos) {
+                m_FastestEncoders[value.substr(0, colon)] = value.substr(colon + 1);
+            }
+        }
+        else {
+            header[key] = value;
+        }
+    }
+
+    if (header["cache_version"] != std::to_string(CACHE_VERSION) || header["binary"] != binaryPath ||
+        header["modified_time"] != std::to_string(modifiedTime) || m_Encoders.empty()) {
+        m_Encoders.clear();
+        m_Muxers.clear();
+        m_PixelFormats.clear();
+        m_FastestEncoders.clear();
+        return false;
+    }
+
+    m_Version = header["version"];
+    m_IsValid = true;
+    return true;
+}
+
+void ofxFFmpegCapabilities::save(const std::string &cachePath, const std::string &binaryPath, int64_t modifiedTime) const
+{
+    // Written next to the cache file and renamed, so another process never reads a half written file.
+    const std::string temporaryPath = cachePath + "." + std::to_string(ofGetSystemTimeMicros());
+    {
+        std::ofstream file(temporaryPath, std::ios::trunc);
+        if (file.is_open() == false) {
+            LOG_WARNING("Cannot write " + temporaryPath + ". The capabilities are not cached.");
+            return;
+        }
+
+        file << "cache_version=" << CACHE_VERSION << "\n";
+        file << "binary=" << binaryPath << "\n";
+        file << "modified_time=" << modifiedTime << "\n";
+        file << "version=" << m_Version << "\n";
+        for (const std::string &encoder : m_Encoders) {
+            file << "encoder=" << encoder << "\n";
+        }
+
+        for (const std::string &muxer : m_Muxers) {
+            file << "muxer=" << muxer << "\n";
+        }
+
+        for (const std::string &format : m_PixelFormats) {
+            file << "pixel_format=" << format << "\n";
+        }
+
+        for (const auto &fastest : m_FastestEncoders) {
+            file << "fastest=" << fastest.first << ":" << fastest.second << "\n";
+        }
+    }
+
+    std::remove(cachePath.c_str());
+    if (std::rename(temporaryPath.c_str(), cachePath.c_str()) != 0) {
+        std::remove(temporaryPath.c_str());
+    }
+}
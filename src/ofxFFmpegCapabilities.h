@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+
+/**
+ * @brief What an ffmpeg binary supports: its version, encoders, muxers and input pixel formats. Probing runs the binary a few times,
+ * so the result is kept in memory and in a cache file that is keyed by the path and the modification time of the binary. Replacing or
+ * updating the binary probes it again.
+ * **Example Usage**
+ * @code
+ *     std::shared_ptr<const ofxFFmpegCapabilities> capabilities = ofxFFmpegCapabilities::probe("ffmpeg");
+ *     if (capabilities->hasMuxer("hls")) {
+ *         ...
+ *     }
+ *
+ *     // e.g. "h264_nvenc" if it works on this machine, otherwise "libx264".
+ *     const std::string encoder = capabilities->getFastestEncoder("h264");
+ * @endcode
+ */
+class ofxFFmpegCapabilities
+{
+public:
+    ofxFFmpegCapabilities();
+
+    /**
+     * @brief Returns the capabilities of the binary, from memory or from the cache file if they are probed before.
+     * @param ffmpegPath The path of the binary or its name if it is in the PATH.
+     * @param cacheDirectory Where the cache file is kept. If this is empty, the user's cache directory is used.
+     * @return This is never null. If the binary cannot be run, isValid() returns false.
+     */
+    static std::shared_ptr<const ofxFFmpegCapabilities> probe(const std::string &ffmpegPath, const std::string &cacheDirectory = "");
+
+    /**
+     * @brief Returns the capabilities of the binary if they are in memory or in the cache file, without running it.
+     * @param ffmpegPath
+     * @param cacheDirectory
+     * @return Returns nullptr if the binary is not probed yet.
+     */
+    static std::shared_ptr<const ofxFFmpegCapabilities> find(const std::string &ffmpegPath, const std::string &cacheDirectory = "");
+
+    /**
+     * @brief Returns false if the binary could not be run.
+     * @return
+     */
+    bool isValid() const;
+
+    const std::string &getVersion() const;
+
+    bool hasEncoder(const std::string &name) const;
+    bool hasMuxer(const std::string &name) const;
+
+    /**
+     * @brief Returns true if the pixel format can be used as the input of ffmpeg.
+     * @param name
+     * @return
+     */
+    bool hasPixelFormat(const std::string &name) const;
+
+    const std::set<std::string> &getEncoders() const;
+    const std::set<std::string> &getMuxers() const;
+    const std::set<std::string> &getPixelFormats() const;
+
+    /**
+     * @brief Returns the fastest encoder of the family that works on this machine, or an empty string if there is none. The known families
+     * are "h264", "hevc", "av1", "vp9", "vp8", "mpeg4" and "prores". The hardware encoders come first, and they are only used if a
+     * short test encode with them succeeded when the binary was probed.
+     * @param family
+     * @return
+     */
+    std::string getFastestEncoder(const std::string &family) const;
+
+private:
+    std::string m_Version;
+    std::set<std::string> m_Encoders, m_Muxers, m_PixelFormats;
+
+    /**
+     * @brief The fastest working encoder of each family.
+     */
+    std::map<std::string, std::string> m_FastestEncoders;
+
+    bool m_IsValid;
+
+private:
+    /**
+     * @brief Returns the capabilities from memory or the cache file, and probes the binary if isProbing is true and they are not found.
+     */
+    static std::shared_ptr<const ofxFFmpegCapabilities> get(const std::string &ffmpegPath, const std::string &cacheDirectory,
+                                                            bool isProbing);
+
+    /**
+     * @brief Runs the binary with each of the listing options and tests the hardware encoders. A test encode is killed if it does not
+     * finish in 10 seconds.
+     */
+    void probeBinary(const std::string &ffmpegPath);
+
+    bool load(const std::string &cachePath, const std::string &binaryPath, int64_t modifiedTime);
+    void save(const std::string &cachePath, const std::string &binaryPath, int64_t modifiedTime) const;
+};
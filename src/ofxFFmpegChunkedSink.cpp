@@ -0,0 +1,215 @@
+#include "ofxFFmpegChunkedSink.h"
+// openFrameworks
+#include "ofLog.h"
+#include "ofFileUtils.h"
+#include "ofUtils.h"
+
+#include "ofxFFmpegProcess.h"
+
+#include <fstream>
+
+// Logging macros
+#define LOG_ERROR(message) ofLogError("") << __FUNCTION__ << ":" << __LINE__ << ": " << message
+#define LOG_WARNING(message) ofLogWarning("") << __FUNCTION__ << ":" << __LINE__ << ": " << message
+
+ofxFFmpegChunkedSink::ofxFFmpegChunkedSink(size_t processCount, size_t chunkFrames, const std::string &outputPath,
+                                           const std::string &ffmpegPath, CommandBuilder commandBuilder)
+    : m_ChunkFrames(std::max<size_t>(chunkFrames, 1))
+    , m_OutputPath(outputPath)
+    , m_FFmpegPath(ffmpegPath)
+    , m_CommandBuilder(commandBuilder)
+    , m_FrameCount(0)
+    , m_IsClosed(false)
+{
+    for (size_t i = 0; i < std::max<size_t>(processCount, 1); i++) {
+        m_Lanes.push_back(std::unique_ptr<Lane>(new Lane()));
+        m_Lanes.back()->thread = std::thread(&ofxFFmpegChunkedSink::processLane, this, m_Lanes.back().get());
+    }
+}
+
+ofxFFmpegChunkedSink::~ofxFFmpegChunkedSink()
+{
+    close();
+}
+
+size_t ofxFFmpegChunkedSink::write(const std::shared_ptr<const ofPixels> &frame)
+{
+    if (m_IsClosed) {
+        return 0;
+    }
+
+    const size_t chunk = static_cast<size_t>(m_FrameCount / m_ChunkFrames);
+    Lane *lane = m_Lanes[chunk % m_Lanes.size()].get();
+    {
+        std::unique_lock<std::mutex> lock(lane->mutex);
+        lane->condition.wait(lock, [this, lane]() {
+            return lane->frames.size() < m_ChunkFrames;
+        });
+
+        lane->frames.emplace_back(chunk, frame);
+    }
+
+    lane->condition.notify_all();
+    m_FrameCount++;
+    return frame->getTotalBytes();
+}
+
+void ofxFFmpegChunkedSink::close()
+{
+    if (m_IsClosed) {
+        return;
+    }
+
+    m_IsClosed = true;
+    for (const std::unique_ptr<Lane> &lane : m_Lanes) {
+        {
+            std::lock_guard<std::mutex> lock(lane->mutex);
+            lane->isClosing = true;
+        }
+
+        lane->condition.notify_all();
+    }
+
+    for (const std::unique_ptr<Lane> &lane : m_Lanes) {
+        if (lane->thread.joinable()) {
+            lane->thread.join();
+        }
+    }
+
+    const std::vector<std::string> chunkPaths = getChunkPaths();
+    if (chunkPaths.empty()) {
+        return;
+    }
+
+    if (concatenate(chunkPaths)) {
+        for (const std::string &path : chunkPaths) {
+            ofFile::removeFile(path, false);
+        }
+    }
+    else {
+        LOG_ERROR("Cannot concatenate the chunks into " + m_OutputPath + ". The chunks are kept.");
+    }
+}
+
+std::vector<std::string> ofxFFmpegChunkedSink::getChunkPaths() const
+{
+    std::lock_guard<std::mutex> lock(m_ChunkMutex);
+    return m_ChunkPaths;
+}
+
+void ofxFFmpegChunkedSink::processLane(Lane *lane)
+{
+    FILE *pipe = nullptr;
+    size_t currentChunk = 0, chunkFrameCount = 0;
+    bool isChunkStarted = false;
+    while (true) {
+        std::pair<size_t, std::shared_ptr<const ofPixels>> item;
+        {
+            std::unique_lock<std::mutex> lock(lane->mutex);
+            lane->condition.wait(lock, [lane]() {
+                return lane->frames.empty() == false || lane->isClosing;
+            });
+
+            if (lane->frames.empty()) {
+                break;
+            }
+
+            item = std::move(lane->frames.front());
+            lane->frames.pop_front();
+        }
+
+        lane->condition.notify_all();
+
+        // The first frame of a chunk starts a new encode.
+        if (isChunkStarted == false || item.first != currentChunk) {
+            if (pipe) {
+#if defined(_WIN32)
+                _pclose(pipe);
+#else
+                pclose(pipe);
+#endif
+            }
+
+            currentChunk = item.first;
+            chunkFrameCount = 0;
+            isChunkStarted = true;
+            const std::string command = m_CommandBuilder(getChunkPath(currentChunk));
+#if defined(_WIN32)
+            pipe = _popen(command.c_str(), "wb");
+#else
+            pipe = ofxFFmpegOpenProcess(command, "w");
+#endif
+            if (pipe == nullptr) {
+                LOG_ERROR("Cannot start ffmpeg for the chunk " + std::to_string(currentChunk) + ". Its frames are discarded.");
+            }
+        }
+
+        chunkFrameCount++;
+        if (pipe == nullptr) {
+            continue;
+        }
+
+        const std::shared_ptr<const ofPixels> &frame = item.second;
+        if (fwrite(frame->getData(), sizeof(char), frame->getTotalBytes(), pipe) != frame->getTotalBytes()) {
+            LOG_WARNING("Cannot write the frame to the chunk " + std::to_string(currentChunk));
+        }
+
+        // Finish the encode as soon as the chunk is complete instead of when the next chunk of this lane starts.
+        if (chunkFrameCount == m_ChunkFrames) {
+#if defined(_WIN32)
+            _pclose(pipe);
+#else
+            pclose(pipe);
+#endif
+            pipe = nullptr;
+        }
+    }
+
+    if (pipe) {
+#if defined(_WIN32)
+        _pclose(pipe);
+#else
+        pclose(pipe);
+#endif
+    }
+}
+
+std::string ofxFFmpegChunkedSink::getChunkPath(size_t chunk)
+{
+    const std::string extension = ofFilePath::getFileExt(m_OutputPath);
+    const std::string path = ofFilePath::removeExt(m_OutputPath) + "_chunk" + std::to_string(chunk) + (extension.empty() ? "" : "." + extension);
+
+    std::lock_guard<std::mutex> lock(m_ChunkMutex);
+    if (m_ChunkPaths.size() <= chunk) {
+        m_ChunkPaths.resize(chunk + 1);
+    }
+
+    m_ChunkPaths[chunk] = path;
+    return path;
+}
+
+bool ofxFFmpegChunkedSink::concatenate(const std::vector<std::string> &chunkPaths)
+{
+    const std::string listPath = m_OutputPath + ".concat.txt";
+    {
+        std::ofstream list(listPath);
+        for (const std::string &path : chunkPaths) {
+            // The paths are quoted for the concat demuxer, single quotes in the path are escaped.
+            std::string escaped = ofFilePath::getAbsolutePath(path, false);
+            ofStringReplace(escaped, "'", "'\\''");
+            list << "file '" << escaped << "'\n";
+        }
+    }
+
+    const std::string command = m_FFmpegPath + " -y -loglevel error -f concat -safe 0 -i \"" + listPath + "\" -c copy \"" + m_OutputPath + "\"";
+#if defined(_WIN32)
+    FILE *pipe = _popen(command.c_str(), "w");
+    const int status = pipe ? _pclose(pipe) : -1;
+#else
+    FILE *pipe = ofxFFmpegOpenProcess(command, "w");
+    const int status = pipe ? pclose(pipe) : -1;
+#endif
+
+    ofFile::removeFile(listPath, false);
+    return status == 0;
+}
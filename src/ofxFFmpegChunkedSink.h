@@ -0,0 +1,69 @@
+#pragma once
+
+#include "ofxFFmpegFrameSink.h"
+
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <condition_variable>
+
+/**
+ * @brief Encodes the frames with several ffmpeg processes at the same time. The frames are split into chunks of chunkFrames frames,
+ * and chunk i is encoded to its own file by lane i % processCount. Every chunk starts a new encode, so each one starts with a keyframe,
+ * and close() joins them into the output file with ffmpeg's concat demuxer without encoding them again.
+ * The frames are not copied, each lane keeps up to chunkFrames of them while they wait for its ffmpeg, and write() blocks when the lane
+ * of the frame is full. This is meant for the offline mode of ofxFFmpegRecorder, see ofxFFmpegRecorder::setChunkedEncoding().
+ */
+class ofxFFmpegChunkedSink : public ofxFFmpegFrameSink
+{
+public:
+    /**
+     * @brief Returns the command that encodes a chunk to the given path, with the raw frames read from stdin.
+     */
+    using CommandBuilder = std::function<std::string(const std::string &chunkPath)>;
+
+    ofxFFmpegChunkedSink(size_t processCount, size_t chunkFrames, const std::string &outputPath, const std::string &ffmpegPath,
+                         CommandBuilder commandBuilder);
+    ~ofxFFmpegChunkedSink();
+
+    size_t write(const std::shared_ptr<const ofPixels> &frame) override;
+
+    /**
+     * @brief Waits for the lanes to encode all of their frames, and concatenates the chunks into the output file.
+     */
+    void close() override;
+
+    /**
+     * @brief Returns the paths of the chunks that were started so far.
+     */
+    std::vector<std::string> getChunkPaths() const;
+
+private:
+    struct Lane {
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable condition;
+
+        /**
+         * @brief The frames and the index of the chunk that each one belongs to.
+         */
+        std::deque<std::pair<size_t, std::shared_ptr<const ofPixels>>> frames;
+        bool isClosing = false;
+    };
+
+    const size_t m_ChunkFrames;
+    const std::string m_OutputPath, m_FFmpegPath;
+    CommandBuilder m_CommandBuilder;
+    std::vector<std::unique_ptr<Lane>> m_Lanes;
+    uint64_t m_FrameCount;
+    bool m_IsClosed;
+
+    mutable std::mutex m_ChunkMutex;
+    std::vector<std::string> m_ChunkPaths;
+
+private:
+    void processLane(Lane *lane);
+    std::string getChunkPath(size_t chunk);
+    bool concatenate(const std::vector<std::string> &chunkPaths);
+};
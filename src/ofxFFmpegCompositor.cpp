@@ -0,0 +1,125 @@
+#include "ofxFFmpegCompositor.h"
+// openFrameworks
+#include "ofLog.h"
+
+#include "ofxFFmpegRecorder.h"
+#include "ofxFFmpegPixelUtils.h"
+
+#include <cstring>
+
+// Logging macros
+#define LOG_ERROR(message) ofLogError("") << __FUNCTION__ << ":" << __LINE__ << ": " << message
+
+ofxFFmpegCompositor::ofxFFmpegCompositor()
+    : m_Columns(0)
+    , m_Rows(0)
+{
+
+}
+
+void ofxFFmpegCompositor::setup(glm::vec2 size, size_t columns, size_t rows, ofPixelFormat format)
+{
+    if (size.x <= 0 || size.y <= 0 || columns == 0 || rows == 0) {
+        LOG_ERROR("The size and the grid of the compositor must not be empty.");
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Pixels.allocate(static_cast<size_t>(size.x), static_cast<size_t>(size.y), format);
+    memset(m_Pixels.getData(), 0, m_Pixels.getTotalBytes());
+    m_Columns = columns;
+    m_Rows = rows;
+}
+
+size_t ofxFFmpegCompositor::getColumns() const
+{
+    return m_Columns;
+}
+
+size_t ofxFFmpegCompositor::getRows() const
+{
+    return m_Rows;
+}
+
+size_t ofxFFmpegCompositor::getTileCount() const
+{
+    return m_Columns * m_Rows;
+}
+
+ofRectangle ofxFFmpegCompositor::getTileRect(size_t sourceId) const
+{
+    if (sourceId >= getTileCount()) {
+        return ofRectangle();
+    }
+
+    // The edges are computed from the index so that the tiles cover the whole frame when the size is not a multiple of the grid.
+    const size_t column = sourceId % m_Columns;
+    const size_t row = sourceId / m_Columns;
+    const size_t left = column * m_Pixels.getWidth() / m_Columns;
+    const size_t right = (column + 1) * m_Pixels.getWidth() / m_Columns;
+    const size_t top = row * m_Pixels.getHeight() / m_Rows;
+    const size_t bottom = (row + 1) * m_Pixels.getHeight() / m_Rows;
+    return ofRectangle(left, top, right - left, bottom - top);
+}
+
+bool ofxFFmpegCompositor::addFrame(size_t sourceId, const ofPixels &pixels)
+{
+    if (sourceId >= getTileCount()) {
+        LOG_ERROR("There is no tile for the source " << sourceId << ".");
+        return false;
+    }
+
+    if (pixels.isAllocated() == false || pixels.getPixelFormat() != m_Pixels.getPixelFormat()
+        || pixels.getTotalBytes() != pixels.getBytesStride() * pixels.getHeight()) {
+        LOG_ERROR("The pixels of the source " << sourceId << " must have the format of the compositor.");
+        return false;
+    }
+
+    const ofRectangle tile = getTileRect(sourceId);
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    ofxFFmpegBlit(pixels, m_Pixels, static_cast<size_t>(tile.x), static_cast<size_t>(tile.y), static_cast<size_t>(tile.width),
+                  static_cast<size_t>(tile.height));
+    return true;
+}
+
+void ofxFFmpegCompositor::clearTile(size_t sourceId)
+{
+    if (sourceId >= getTileCount()) {
+        return;
+    }
+
+    const ofRectangle tile = getTileRect(sourceId);
+    const size_t bytesPerPixel = m_Pixels.getBytesPerPixel();
+    const size_t stride = m_Pixels.getBytesStride();
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    unsigned char *row = m_Pixels.getData() + static_cast<size_t>(tile.y) * stride + static_cast<size_t>(tile.x) * bytesPerPixel;
+    for (size_t y = 0; y < static_cast<size_t>(tile.height); y++) {
+        memset(row, 0, static_cast<size_t>(tile.width) * bytesPerPixel);
+        row += stride;
+    }
+}
+
+size_t ofxFFmpegCompositor::update(ofxFFmpegRecorder &recorder)
+{
+    // The frame is copied straight into a frame of the recorder's pool, which the recorder queues without another copy.
+    std::shared_ptr<ofPixels> frame = recorder.acquireFrame();
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (m_Pixels.isAllocated() == false) {
+            LOG_ERROR("The compositor is not set up.");
+            return 0;
+        }
+
+        *frame = m_Pixels;
+    }
+
+    // addFrame() blocks in the offline mode while the queue is full, so it is called without the lock to not stall the sources.
+    return recorder.addFrame(frame);
+}
+
+ofPixels ofxFFmpegCompositor::getPixels() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Pixels;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "ofPixels.h"
+#include "ofRectangle.h"
+
+#include <mutex>
+
+class ofxFFmpegRecorder;
+
+/**
+ * @brief Tiles several sources into one frame in a grid, so that they can be recorded as a single video without a GPU composite or a
+ * second ffmpeg pass. Each source is copied into its tile as soon as it is added, and update() hands the composited frame to the
+ * recorder. Sources that do not have the tile size are scaled with nearest neighbour sampling.
+ * **Example Usage**
+ * @code
+ *     compositor.setup(glm::vec2(1920, 1080), 2, 2);
+ *     recorder.setup(true, false, glm::vec2(1920, 1080));
+ *     recorder.startCustomRecord();
+ *     ...
+ *     compositor.addFrame(0, camera0.getPixels());
+ *     compositor.addFrame(1, camera1.getPixels());
+ *     ...
+ *     compositor.update(recorder);
+ * @endcode
+ * addFrame() can be called from the threads of the sources.
+ */
+class ofxFFmpegCompositor
+{
+public:
+    ofxFFmpegCompositor();
+
+    /**
+     * @brief Allocates the composited frame and clears it to black.
+     * @param size The size of the composited frame. This should be the video size of the recorder.
+     * @param columns
+     * @param rows
+     * @param format All of the sources must have this format.
+     */
+    void setup(glm::vec2 size, size_t columns, size_t rows, ofPixelFormat format = OF_PIXELS_RGB);
+
+    size_t getColumns() const;
+    size_t getRows() const;
+
+    /**
+     * @brief Returns the number of tiles, the valid source ids are from 0 to getTileCount() - 1 in row major order.
+     */
+    size_t getTileCount() const;
+
+    /**
+     * @brief Returns the area of the composited frame that the given source is copied to.
+     */
+    ofRectangle getTileRect(size_t sourceId) const;
+
+    /**
+     * @brief Copies pixels into the tile of sourceId. The tile keeps its contents until the source adds a new frame.
+     * @param sourceId
+     * @param pixels
+     * @return Returns false if the source id or the pixel format is not valid.
+     */
+    bool addFrame(size_t sourceId, const ofPixels &pixels);
+
+    /**
+     * @brief Clears the tile of sourceId to black, e.g. when a source is disconnected.
+     */
+    void clearTile(size_t sourceId);
+
+    /**
+     * @brief Adds the composited frame to the recorder. Call this once per tick. The frame is copied once, into a frame of the
+     * recorder's pool, and the sources are only locked while it is copied, not while the recorder queues it.
+     * @return The number of frames that were queued by the recorder.
+     */
+    size_t update(ofxFFmpegRecorder &recorder);
+
+    /**
+     * @brief Returns a copy of the composited frame.
+     */
+    ofPixels getPixels() const;
+
+private:
+    mutable std::mutex m_Mutex;
+    ofPixels m_Pixels;
+    size_t m_Columns, m_Rows;
+};
@@ -0,0 +1,85 @@
+#include "ofxFFmpegFramePool.h"
+
+ofxFFmpegFramePool::ofxFFmpegFramePool()
+    : m_AllocatedCount(0)
+    , m_FreeCount(0)
+    , m_MaxFreeCount(8)
+{
+
+}
+
+ofxFFmpegFramePool::~ofxFFmpegFramePool()
+{
+    clear();
+}
+
+std::shared_ptr<ofPixels> ofxFFmpegFramePool::acquire()
+{
+    ofPixels *pixels = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (m_FreeFrames.empty() == false) {
+            pixels = m_FreeFrames.back();
+            m_FreeFrames.pop_back();
+            m_FreeCount--;
+        }
+    }
+
+    if (pixels == nullptr) {
+        pixels = new ofPixels();
+        m_AllocatedCount++;
+    }
+
+    // The deleter keeps the pool alive until all of the frames it handed out are released.
+    std::shared_ptr<ofxFFmpegFramePool> pool = shared_from_this();
+    return std::shared_ptr<ofPixels>(pixels, [pool](ofPixels *released) {
+        pool->release(released);
+    });
+}
+
+size_t ofxFFmpegFramePool::getAllocatedCount() const
+{
+    return m_AllocatedCount;
+}
+
+size_t ofxFFmpegFramePool::getFreeCount() const
+{
+    return m_FreeCount;
+}
+
+size_t ofxFFmpegFramePool::getMaxFreeCount() const
+{
+    return m_MaxFreeCount;
+}
+
+void ofxFFmpegFramePool::setMaxFreeCount(size_t count)
+{
+    m_MaxFreeCount = count;
+}
+
+void ofxFFmpegFramePool::clear()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    for (ofPixels *pixels : m_FreeFrames) {
+        delete pixels;
+    }
+
+    m_AllocatedCount -= m_FreeFrames.size();
+    m_FreeFrames.clear();
+    m_FreeCount = 0;
+}
+
+void ofxFFmpegFramePool::release(ofPixels *pixels)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (m_FreeFrames.size() < m_MaxFreeCount) {
+            m_FreeFrames.push_back(pixels);
+            m_FreeCount++;
+            return;
+        }
+    }
+
+    delete pixels;
+    m_AllocatedCount--;
+}
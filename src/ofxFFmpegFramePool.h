@@ -0,0 +1,55 @@
+#pragma once
+
+#include "ofPixels.h"
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+
+/**
+ * @brief Recycles the ofPixels that are queued for the writer thread so that a new frame buffer is not allocated for every added
+ * frame. The frames are handed out as shared pointers that return themselves to the pool when the last reference is released.
+ */
+class ofxFFmpegFramePool : public std::enable_shared_from_this<ofxFFmpegFramePool>
+{
+public:
+    ofxFFmpegFramePool();
+    ~ofxFFmpegFramePool();
+
+    /**
+     * @brief Returns a frame from the pool, or a new one if the pool is empty. The returned frame may still have the size and the
+     * contents of its previous use, assigning or allocating it with the same size does not reallocate the memory.
+     */
+    std::shared_ptr<ofPixels> acquire();
+
+    /**
+     * @brief Returns the number of frames that are currently allocated by the pool. This includes the frames in use.
+     */
+    size_t getAllocatedCount() const;
+
+    /**
+     * @brief Returns the number of frames that are waiting in the pool to be reused.
+     */
+    size_t getFreeCount() const;
+
+    size_t getMaxFreeCount() const;
+
+    /**
+     * @brief The frames that are released when the pool already keeps this many free frames are deleted. This bounds the memory
+     * that is kept around after a spike. The default value is 8.
+     */
+    void setMaxFreeCount(size_t count);
+
+    /**
+     * @brief Deletes all of the free frames.
+     */
+    void clear();
+
+private:
+    mutable std::mutex m_Mutex;
+    std::vector<ofPixels *> m_FreeFrames;
+    std::atomic<size_t> m_AllocatedCount, m_FreeCount, m_MaxFreeCount;
+
+private:
+    void release(ofPixels *pixels);
+};
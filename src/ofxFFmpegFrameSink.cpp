@@ -0,0 +1,172 @@
+#include "ofxFFmpegFrameSink.h"
+// openFrameworks
+#include "ofLog.h"
+
+#if !defined(_WIN32)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// Logging macros
+#define LOG_ERROR(message) ofLogError("") << __FUNCTION__ << ":" << __LINE__ << ": " << message
+#define LOG_WARNING(message) ofLogWarning("") << __FUNCTION__ << ":" << __LINE__ << ": " << message
+
+ofxFFmpegPipeSink::ofxFFmpegPipeSink(FILE *pipe)
+    : m_Pipe(pipe)
+{
+
+}
+
+size_t ofxFFmpegPipeSink::write(const std::shared_ptr<const ofPixels> &frame)
+{
+    return fwrite(frame->getData(), sizeof(char), frame->getTotalBytes(), m_Pipe);
+}
+
+void ofxFFmpegPipeSink::flush()
+{
+    fflush(m_Pipe);
+}
+
+int ofxFFmpegPipeSink::getFileDescriptor() const
+{
+#if defined(_WIN32)
+    return -1;
+#else
+    return fileno(m_Pipe);
+#endif
+}
+
+FILE *ofxFFmpegPipeSink::getPipe() const
+{
+    return m_Pipe;
+}
+
+ofxFFmpegRawFileSink::ofxFFmpegRawFileSink(const std::string &path)
+    : m_File(fopen(path.c_str(), "wb"))
+{
+    if (m_File == nullptr) {
+        LOG_ERROR("Cannot open " + path);
+    }
+}
+
+ofxFFmpegRawFileSink::~ofxFFmpegRawFileSink()
+{
+    close();
+}
+
+bool ofxFFmpegRawFileSink::isOpen() const
+{
+    return m_File != nullptr;
+}
+
+size_t ofxFFmpegRawFileSink::write(const std::shared_ptr<const ofPixels> &frame)
+{
+    if (m_File == nullptr) {
+        return 0;
+    }
+
+    return fwrite(frame->getData(), sizeof(char), frame->getTotalBytes(), m_File);
+}
+
+void ofxFFmpegRawFileSink::flush()
+{
+    if (m_File) {
+        fflush(m_File);
+    }
+}
+
+void ofxFFmpegRawFileSink::close()
+{
+    if (m_File) {
+        fclose(m_File);
+        m_File = nullptr;
+    }
+}
+
+ofxFFmpegCallbackSink::ofxFFmpegCallbackSink(Callback callback)
+    : m_Callback(callback)
+{
+
+}
+
+size_t ofxFFmpegCallbackSink::write(const std::shared_ptr<const ofPixels> &frame)
+{
+    if (m_Callback) {
+        m_Callback(frame);
+    }
+
+    return frame->getTotalBytes();
+}
+
+ofxFFmpegUnixSocketSink::ofxFFmpegUnixSocketSink(const std::string &socketPath)
+    : m_Socket(-1)
+{
+#if defined(_WIN32)
+    LOG_ERROR("Unix sockets are not supported on Windows.");
+#else
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.length() >= sizeof(address.sun_path)) {
+        LOG_ERROR("The socket path is too long: " + socketPath);
+        return;
+    }
+
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    m_Socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_Socket < 0 || connect(m_Socket, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        LOG_ERROR("Cannot connect to " + socketPath);
+        close();
+    }
+#endif
+}
+
+ofxFFmpegUnixSocketSink::~ofxFFmpegUnixSocketSink()
+{
+    close();
+}
+
+bool ofxFFmpegUnixSocketSink::isConnected() const
+{
+    return m_Socket >= 0;
+}
+
+size_t ofxFFmpegUnixSocketSink::write(const std::shared_ptr<const ofPixels> &frame)
+{
+    size_t written = 0;
+#if !defined(_WIN32)
+    if (m_Socket < 0) {
+        return 0;
+    }
+
+    const char *data = reinterpret_cast<const char *>(frame->getData());
+    const size_t length = frame->getTotalBytes();
+    while (written < length) {
+#if defined(MSG_NOSIGNAL)
+        const ssize_t result = send(m_Socket, data + written, length - written, MSG_NOSIGNAL);
+#else
+        const ssize_t result = send(m_Socket, data + written, length - written, 0);
+#endif
+        if (result <= 0) {
+            LOG_WARNING("The socket is disconnected.");
+            close();
+            break;
+        }
+
+        written += result;
+    }
+#endif
+
+    return written;
+}
+
+void ofxFFmpegUnixSocketSink::close()
+{
+#if !defined(_WIN32)
+    if (m_Socket >= 0) {
+        ::close(m_Socket);
+        m_Socket = -1;
+    }
+#endif
+}
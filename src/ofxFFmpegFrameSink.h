@@ -0,0 +1,112 @@
+#pragma once
+
+#include "ofPixels.h"
+
+#include <memory>
+#include <functional>
+
+/**
+ * @brief A destination for the paced frame stream of ofxFFmpegRecorder. The writer thread calls write() for every frame in order,
+ * including the duplicates that are inserted to keep up with the fps, and flush() and close() when the recording is stopped. The
+ * frames are the ones in the recorder's queue, they are not copied for the sinks and they must not be modified.
+ */
+class ofxFFmpegFrameSink
+{
+public:
+    virtual ~ofxFFmpegFrameSink() {}
+
+    /**
+     * @brief Writes the frame. This is called from the writer thread.
+     * @param frame
+     * @return The number of bytes written.
+     */
+    virtual size_t write(const std::shared_ptr<const ofPixels> &frame) = 0;
+
+    virtual void flush() {}
+
+    /**
+     * @brief If the sink writes to a file descriptor, returning it lets ofxFFmpegWriterPool write the frames without blocking.
+     * The default implementation returns -1, and the frames are written with write().
+     */
+    virtual int getFileDescriptor() const
+    {
+        return -1;
+    }
+
+    /**
+     * @brief Called once the last frame is written. The sink is not used by the recorder after this.
+     */
+    virtual void close() {}
+};
+
+/**
+ * @brief Writes the raw frames to a pipe. This is the sink that is used for ffmpeg, the pipe is not closed by the sink.
+ */
+class ofxFFmpegPipeSink : public ofxFFmpegFrameSink
+{
+public:
+    ofxFFmpegPipeSink(FILE *pipe);
+
+    size_t write(const std::shared_ptr<const ofPixels> &frame) override;
+    void flush() override;
+    int getFileDescriptor() const override;
+
+    FILE *getPipe() const;
+
+private:
+    FILE *m_Pipe;
+};
+
+/**
+ * @brief Writes the raw frames one after another to a file (e.g. to be encoded later with "-f rawvideo", or to /dev/null).
+ */
+class ofxFFmpegRawFileSink : public ofxFFmpegFrameSink
+{
+public:
+    ofxFFmpegRawFileSink(const std::string &path);
+    ~ofxFFmpegRawFileSink();
+
+    bool isOpen() const;
+
+    size_t write(const std::shared_ptr<const ofPixels> &frame) override;
+    void flush() override;
+    void close() override;
+
+private:
+    FILE *m_File;
+};
+
+/**
+ * @brief Hands the frames to a callback on the writer thread. The callback can keep the frame without copying it, the frame
+ * returns to the recorder's pool when the last reference is released.
+ */
+class ofxFFmpegCallbackSink : public ofxFFmpegFrameSink
+{
+public:
+    using Callback = std::function<void(const std::shared_ptr<const ofPixels> &frame)>;
+
+    ofxFFmpegCallbackSink(Callback callback);
+
+    size_t write(const std::shared_ptr<const ofPixels> &frame) override;
+
+private:
+    Callback m_Callback;
+};
+
+/**
+ * @brief Writes the raw frames to a Unix domain stream socket that another process is listening on. This is not available on Windows.
+ */
+class ofxFFmpegUnixSocketSink : public ofxFFmpegFrameSink
+{
+public:
+    ofxFFmpegUnixSocketSink(const std::string &socketPath);
+    ~ofxFFmpegUnixSocketSink();
+
+    bool isConnected() const;
+
+    size_t write(const std::shared_ptr<const ofPixels> &frame) override;
+    void close() override;
+
+private:
+    int m_Socket;
+};
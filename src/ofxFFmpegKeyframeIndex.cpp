@@ -0,0 +1,162 @@
+#include "ofxFFmpegKeyframeIndex.h"
+// openFrameworks
+#include "ofLog.h"
+
+#include <algorithm>
+#include <cstring>
+
+// Logging macros
+#define LOG_ERROR(message) ofLogError("") << __FUNCTION__ << ":" << __LINE__ << ": " << message
+
+namespace
+{
+
+const char MAGIC[4] = {'O', 'F', 'K', 'I'};
+const uint32_t VERSION = 1;
+
+struct Header {
+    char magic[4];
+    uint32_t version;
+    float fps;
+    uint32_t entrySize;
+};
+
+static_assert(sizeof(Header) == 16, "The header of the keyframe index must be 16 bytes.");
+static_assert(sizeof(ofxFFmpegKeyframeIndexEntry) == 24, "The entries of the keyframe index must be 24 bytes.");
+
+}
+
+bool ofxFFmpegKeyframeIndexEntry::isKeyframe() const
+{
+    return (flags & KEYFRAME) != 0;
+}
+
+double ofxFFmpegKeyframeIndexEntry::getTime() const
+{
+    return pts / 1000000.0;
+}
+
+ofxFFmpegKeyframeIndex::ofxFFmpegKeyframeIndex()
+    : m_Fps(0.f)
+{
+
+}
+
+ofxFFmpegKeyframeIndex::~ofxFFmpegKeyframeIndex()
+{
+    close();
+}
+
+std::string ofxFFmpegKeyframeIndex::getPath(const std::string &videoPath)
+{
+    return videoPath + ".kidx";
+}
+
+bool ofxFFmpegKeyframeIndex::load(const std::string &path)
+{
+    m_Entries.clear();
+    m_Keyframes.clear();
+    m_Fps = 0.f;
+
+    std::ifstream file(path, std::ios::binary);
+    Header header;
+    if (file.read(reinterpret_cast<char *>(&header), sizeof(header)).good() == false || std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+        LOG_ERROR(path + " is not a keyframe index.");
+        return false;
+    }
+
+    if (header.version != VERSION || header.entrySize != sizeof(ofxFFmpegKeyframeIndexEntry)) {
+        LOG_ERROR("The version of the keyframe index " + path + " is not supported.");
+        return false;
+    }
+
+    m_Fps = header.fps;
+
+    // A partial entry at the end is one that is being written.
+    ofxFFmpegKeyframeIndexEntry entry;
+    while (file.read(reinterpret_cast<char *>(&entry), sizeof(entry)).good()) {
+        if (entry.isKeyframe()) {
+            m_Keyframes.push_back(m_Entries.size());
+        }
+
+        m_Entries.push_back(entry);
+    }
+
+    return true;
+}
+
+float ofxFFmpegKeyframeIndex::getFps() const
+{
+    return m_Fps;
+}
+
+const std::vector<ofxFFmpegKeyframeIndexEntry> &ofxFFmpegKeyframeIndex::getEntries() const
+{
+    return m_Entries;
+}
+
+const ofxFFmpegKeyframeIndexEntry *ofxFFmpegKeyframeIndex::findKeyframe(double seconds) const
+{
+    if (m_Keyframes.empty()) {
+        return nullptr;
+    }
+
+    const int64_t pts = static_cast<int64_t>(seconds * 1000000.0);
+    auto next = std::upper_bound(m_Keyframes.begin(), m_Keyframes.end(), pts, [this](int64_t value, size_t index) {
+        return value < m_Entries[index].pts;
+    });
+
+    return &m_Entries[next == m_Keyframes.begin() ? *next : *(next - 1)];
+}
+
+const ofxFFmpegKeyframeIndexEntry *ofxFFmpegKeyframeIndex::findKeyframeForFrame(uint32_t frame) const
+{
+    if (m_Keyframes.empty()) {
+        return nullptr;
+    }
+
+    auto next = std::upper_bound(m_Keyframes.begin(), m_Keyframes.end(), frame, [this](uint32_t value, size_t index) {
+        return value < m_Entries[index].frame;
+    });
+
+    return &m_Entries[next == m_Keyframes.begin() ? *next : *(next - 1)];
+}
+
+bool ofxFFmpegKeyframeIndex::open(const std::string &path, float fps)
+{
+    close();
+
+    m_File.open(path, std::ios::binary | std::ios::trunc);
+    if (m_File.is_open() == false) {
+        LOG_ERROR("Cannot create the keyframe index " + path);
+        return false;
+    }
+
+    Header header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.fps = fps;
+    header.entrySize = sizeof(ofxFFmpegKeyframeIndexEntry);
+    m_File.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    m_File.flush();
+    return true;
+}
+
+void ofxFFmpegKeyframeIndex::append(const ofxFFmpegKeyframeIndexEntry &entry)
+{
+    if (m_File.is_open() == false) {
+        return;
+    }
+
+    m_File.write(reinterpret_cast<const char *>(&entry), sizeof(entry));
+    if (entry.isKeyframe()) {
+        m_File.flush();
+    }
+}
+
+void ofxFFmpegKeyframeIndex::close()
+{
+    if (m_File.is_open()) {
+        m_File.close();
+    }
+}
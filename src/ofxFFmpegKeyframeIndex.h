@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief A packet of the encoded video in ofxFFmpegKeyframeIndex.
+ */
+struct ofxFFmpegKeyframeIndexEntry {
+    enum Flags : uint32_t {
+        KEYFRAME = 1
+    };
+
+    /**
+     * @brief The presentation time in microseconds.
+     */
+    int64_t pts = 0;
+
+    /**
+     * @brief The offset of the packet in the encoded stream, which is the total size of the packets before it. This is the offset in the
+     * file for a raw stream (e.g. .h264 or .hevc). Other containers add their own headers between the packets, so there it is only an
+     * estimate of the position.
+     */
+    uint64_t offset = 0;
+
+    /**
+     * @brief The index of the frame in presentation order, the same as the index of the frame that was added to the recorder.
+     */
+    uint32_t frame = 0;
+    uint32_t flags = 0;
+
+    bool isKeyframe() const;
+    double getTime() const;
+};
+
+/**
+ * @brief The packet index that ofxFFmpegRecorder::setWritingKeyframeIndex() writes next to the video while it is recorded, so that a
+ * thumbnail or a seek can go straight to the keyframe before a given time or frame without probing the video. The entries are in the
+ * order that the packets are written, which is the decode order.
+ *
+ * The file starts with a 16 byte header: "OFKI", the version (1), the fps as a float and the size of an entry (24). The entries follow as
+ * pts, offset, frame and flags, in the byte order of the machine that wrote the file. The file is flushed after each keyframe, so it can
+ * be read while the recording is in proggress.
+ * **Example Usage**
+ * @code
+ *     ofxFFmpegKeyframeIndex index;
+ *     if (index.load(ofxFFmpegKeyframeIndex::getPath("video.mp4"))) {
+ *         const ofxFFmpegKeyframeIndexEntry *keyframe = index.findKeyframe(42.f);
+ *         // Seek to keyframe->getTime() and decode from there.
+ *     }
+ * @endcode
+ */
+class ofxFFmpegKeyframeIndex
+{
+public:
+    ofxFFmpegKeyframeIndex();
+    ~ofxFFmpegKeyframeIndex();
+
+    /**
+     * @brief Returns the path of the index of the given video.
+     * @param videoPath
+     * @return
+     */
+    static std::string getPath(const std::string &videoPath);
+
+    /**
+     * @brief Reads the index. An index that is still being written can be loaded, it contains the packets up to the last keyframe.
+     * @param path
+     * @return Returns false if the file cannot be read or if it is not an index.
+     */
+    bool load(const std::string &path);
+
+    float getFps() const;
+    const std::vector<ofxFFmpegKeyframeIndexEntry> &getEntries() const;
+
+    /**
+     * @brief Returns the last keyframe that is shown at or before the given time, or the first keyframe if there is none before it.
+     * @param seconds
+     * @return Returns nullptr if there is no keyframe.
+     */
+    const ofxFFmpegKeyframeIndexEntry *findKeyframe(double seconds) const;
+
+    /**
+     * @brief Returns the last keyframe at or before the given frame, or the first keyframe if there is none before it.
+     * @param frame
+     * @return Returns nullptr if there is no keyframe.
+     */
+    const ofxFFmpegKeyframeIndexEntry *findKeyframeForFrame(uint32_t frame) const;
+
+    /**
+     * @brief Creates the file and writes the header. Used by the recorder.
+     * @param path
+     * @param fps
+     * @return
+     */
+    bool open(const std::string &path, float fps);
+
+    /**
+     * @brief Appends the entry to the file. The file is flushed when the entry is a keyframe.
+     * @param entry
+     */
+    void append(const ofxFFmpegKeyframeIndexEntry &entry);
+    void close();
+
+private:
+    float m_Fps;
+    std::vector<ofxFFmpegKeyframeIndexEntry> m_Entries;
+
+    /**
+     * @brief The indices of the keyframes in m_Entries. The keyframes are in presentation order even if the other packets are not.
+     */
+    std::vector<size_t> m_Keyframes;
+
+    std::ofstream m_File;
+};
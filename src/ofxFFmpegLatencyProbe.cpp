@@ -0,0 +1,193 @@
+#include "ofxFFmpegLatencyProbe.h"
+// openFrameworks
+#include "ofLog.h"
+
+#include "ofxFFmpegProcess.h"
+
+#include <chrono>
+
+#if !defined(_WIN32)
+#include <signal.h>
+#endif
+
+// Logging macros
+#define LOG_ERROR(message) ofLogError("") << __FUNCTION__ << ":" << __LINE__ << ": " << message
+#define LOG_WARNING(message) ofLogWarning("") << __FUNCTION__ << ":" << __LINE__ << ": " << message
+
+ofxFFmpegLatencyProbe::ofxFFmpegLatencyProbe()
+    : m_ReceiverFile(nullptr)
+    , m_ReceiverProcess(-1)
+    , m_Size(0, 0)
+    , m_IsRunning(false)
+{
+    resetLatencies();
+}
+
+ofxFFmpegLatencyProbe::~ofxFFmpegLatencyProbe()
+{
+    stop();
+}
+
+bool ofxFFmpegLatencyProbe::setup(const std::string &url, glm::vec2 size, const std::string &ffmpegPath)
+{
+#if defined(_WIN32)
+    LOG_ERROR("The latency probe is not supported on Windows.");
+    return false;
+#else
+    stop();
+    resetLatencies();
+    m_Size = size;
+
+    std::vector<std::string> args;
+    args.push_back("-hide_banner");
+    args.push_back("-loglevel error");
+    args.push_back("-fflags nobuffer");
+    args.push_back("-flags low_delay");
+    args.push_back("-probesize 32");
+    args.push_back("-analyzeduration 0");
+    args.push_back("-i \"" + url + "\"");
+
+    // Only the luma is needed to read the stamp.
+    args.push_back("-f rawvideo");
+    args.push_back("-pix_fmt gray");
+    args.push_back("-");
+
+    // The shell prints its pid before it is replaced with ffmpeg, so that the receiver can be killed when the stream does not end.
+    std::string cmd = "echo $$; exec " + ffmpegPath + " ";
+    for (auto arg : args) {
+        cmd += arg + " ";
+    }
+
+    m_ReceiverFile = ofxFFmpegOpenProcess(cmd, "r");
+    if (m_ReceiverFile == nullptr || fscanf(m_ReceiverFile, "%d", &m_ReceiverProcess) != 1 || fgetc(m_ReceiverFile) != '\n') {
+        LOG_ERROR("Cannot start the receiver.");
+        stop();
+        return false;
+    }
+
+    m_IsRunning = true;
+    m_Thread = std::thread(&ofxFFmpegLatencyProbe::processFrames, this);
+    return true;
+#endif
+}
+
+void ofxFFmpegLatencyProbe::stop()
+{
+    m_IsRunning = false;
+
+#if !defined(_WIN32)
+    if (m_ReceiverProcess > 0) {
+        kill(m_ReceiverProcess, SIGTERM);
+        m_ReceiverProcess = -1;
+    }
+#endif
+
+    if (m_Thread.joinable()) {
+        m_Thread.join();
+    }
+
+#if !defined(_WIN32)
+    if (m_ReceiverFile) {
+        pclose(m_ReceiverFile);
+        m_ReceiverFile = nullptr;
+    }
+#endif
+}
+
+void ofxFFmpegLatencyProbe::stamp(ofPixels &pixels) const
+{
+    const size_t cellSize = getCellSize(pixels.getWidth(), pixels.getHeight());
+    if (cellSize == 0) {
+        LOG_WARNING("The frame is too small to be stamped.");
+        return;
+    }
+
+    // 24 bits of time and 8 bits of checksum, so that the frames that are decoded with artifacts can be skipped.
+    const uint32_t timestamp = getTimestamp();
+    const uint32_t checksum = (timestamp ^ (timestamp >> 8) ^ (timestamp >> 16)) & 0xFF;
+    const uint32_t value = (timestamp << 8) | checksum;
+
+    const size_t bytesPerPixel = pixels.getBytesPerPixel();
+    const size_t stride = pixels.getBytesStride();
+    unsigned char *data = pixels.getData();
+    for (size_t cell = 0; cell < CellCount; cell++) {
+        const unsigned char color = (value >> (CellCount - 1 - cell)) & 1 ? 255 : 0;
+        for (size_t y = 0; y < cellSize; y++) {
+            memset(data + y * stride + cell * cellSize * bytesPerPixel, color, cellSize * bytesPerPixel);
+        }
+    }
+}
+
+float ofxFFmpegLatencyProbe::getLatency() const
+{
+    return m_Latency;
+}
+
+float ofxFFmpegLatencyProbe::getAverageLatency() const
+{
+    const uint64_t count = m_SampleCount;
+    return count > 0 ? static_cast<float>(m_TotalLatency / count) : 0.f;
+}
+
+float ofxFFmpegLatencyProbe::getMaxLatency() const
+{
+    return m_MaxLatency;
+}
+
+uint64_t ofxFFmpegLatencyProbe::getSampleCount() const
+{
+    return m_SampleCount;
+}
+
+void ofxFFmpegLatencyProbe::resetLatencies()
+{
+    m_Latency = 0.f;
+    m_MaxLatency = 0.f;
+    m_TotalLatency = 0.0;
+    m_SampleCount = 0;
+}
+
+size_t ofxFFmpegLatencyProbe::getCellSize(size_t width, size_t height)
+{
+    return std::min(width / CellCount, height / 4);
+}
+
+uint32_t ofxFFmpegLatencyProbe::getTimestamp()
+{
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(now).count()) & 0xFFFFFF;
+}
+
+void ofxFFmpegLatencyProbe::processFrames()
+{
+    const size_t width = m_Size.x;
+    const size_t height = m_Size.y;
+    const size_t cellSize = getCellSize(width, height);
+    std::vector<unsigned char> frame(width * height);
+
+    while (m_IsRunning && cellSize > 0 && fread(frame.data(), 1, frame.size(), m_ReceiverFile) == frame.size()) {
+        const uint32_t now = getTimestamp();
+
+        // Read the center of each cell.
+        uint32_t value = 0;
+        for (size_t cell = 0; cell < CellCount; cell++) {
+            const size_t center = (cellSize / 2) * width + cell * cellSize + cellSize / 2;
+            value = (value << 1) | (frame[center] > 127 ? 1 : 0);
+        }
+
+        const uint32_t timestamp = value >> 8;
+        if ((value & 0xFF) != ((timestamp ^ (timestamp >> 8) ^ (timestamp >> 16)) & 0xFF)) {
+            continue;
+        }
+
+        // The timestamps wrap around every ~4.6 hours.
+        const float latency = static_cast<float>((now - timestamp) & 0xFFFFFF);
+        m_Latency = latency;
+        if (latency > m_MaxLatency) {
+            m_MaxLatency = latency;
+        }
+
+        m_TotalLatency = m_TotalLatency + latency;
+        m_SampleCount++;
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "ofPixels.h"
+
+#include <thread>
+#include <atomic>
+
+/**
+ * @brief Measures the delay from the moment a frame is added to the recorder until it is decoded by a receiver on the same machine.
+ * stamp() draws the current time into the top of the frame as a row of black and white cells. The probe runs a second ffmpeg
+ * process that receives the stream, and a thread that reads the stamp back from each decoded frame and compares it to the clock.
+ * The stamp uses the full width of the frame, so the frames should be at least 128 pixels wide.
+ * **Example Usage**
+ * @code
+ *     probe.setup("udp://127.0.0.1:1234", glm::vec2(1280, 720));
+ *     ...
+ *     probe.stamp(pixels);
+ *     recorder.addFrame(pixels);
+ *     ofDrawBitmapString(ofToString(probe.getLatency()) + " ms", 10, 20);
+ * @endcode
+ * This is not supported on Windows.
+ */
+class ofxFFmpegLatencyProbe
+{
+public:
+    ofxFFmpegLatencyProbe();
+    ~ofxFFmpegLatencyProbe();
+
+    /**
+     * @brief Starts receiving the stream.
+     * @param url The url that the receiver reads. For SRT this must be the listener side, e.g. "srt://127.0.0.1:9000?mode=listener".
+     * RTP is not supported because it needs an SDP file.
+     * @param size The size of the streamed frames.
+     * @param ffmpegPath
+     * @return Returns false if the receiver cannot be started.
+     */
+    bool setup(const std::string &url, glm::vec2 size, const std::string &ffmpegPath = "ffmpeg");
+
+    /**
+     * @brief Stops the receiver.
+     */
+    void stop();
+
+    /**
+     * @brief Draws the current time into the top rows of pixels.
+     * @param pixels
+     */
+    void stamp(ofPixels &pixels) const;
+
+    /**
+     * @brief Returns the latency of the last received frame in milliseconds.
+     */
+    float getLatency() const;
+    float getAverageLatency() const;
+    float getMaxLatency() const;
+
+    /**
+     * @brief Returns the number of received frames that had a valid stamp.
+     */
+    uint64_t getSampleCount() const;
+
+    void resetLatencies();
+
+private:
+    static const size_t CellCount = 32;
+
+    FILE *m_ReceiverFile;
+    int m_ReceiverProcess;
+    glm::vec2 m_Size;
+
+    std::thread m_Thread;
+    std::atomic<bool> m_IsRunning;
+    std::atomic<float> m_Latency, m_MaxLatency;
+    std::atomic<double> m_TotalLatency;
+    std::atomic<uint64_t> m_SampleCount;
+
+private:
+    /**
+     * @brief Returns the cell size in pixels for a frame of the given size.
+     */
+    static size_t getCellSize(size_t width, size_t height);
+
+    /**
+     * @brief Returns the lower 24 bits of the current time in milliseconds.
+     */
+    static uint32_t getTimestamp();
+
+    void processFrames();
+};
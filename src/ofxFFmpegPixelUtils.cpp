@@ -0,0 +1,455 @@
+#include "ofxFFmpegPixelUtils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OFX_FFMPEG_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define OFX_FFMPEG_NEON
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+// The operations of the QOI format, see https://qoiformat.org/qoi-specification.pdf
+const unsigned char QOI_OP_INDEX = 0x00;
+const unsigned char QOI_OP_DIFF = 0x40;
+const unsigned char QOI_OP_LUMA = 0x80;
+const unsigned char QOI_OP_RUN = 0xc0;
+const unsigned char QOI_OP_RGB = 0xfe;
+const unsigned char QOI_OP_RGBA = 0xff;
+const unsigned char QOI_MASK = 0xc0;
+
+struct QoiPixel {
+    unsigned char r, g, b, a;
+
+    bool operator==(const QoiPixel &other) const
+    {
+        return r == other.r && g == other.g && b == other.b && a == other.a;
+    }
+};
+
+inline size_t qoiHash(const QoiPixel &pixel)
+{
+    return (pixel.r * 3 + pixel.g * 5 + pixel.b * 7 + pixel.a * 11) % 64;
+}
+
+/**
+ * @brief Copies every other pixel of the source row, which is a nearest neighbour scale to half the width.
+ */
+void decimateRow(const unsigned char *source, unsigned char *destination, size_t width, size_t bytesPerPixel)
+{
+    size_t column = 0;
+
+#if defined(OFX_FFMPEG_SSE2)
+    if (bytesPerPixel == 4) {
+        // The even 32 bit lanes of two registers are four destination pixels.
+        for (; column + 4 <= width; column += 4) {
+            const __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + column * 8));
+            const __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + column * 8 + 16));
+            const __m128i pixels = _mm_unpacklo_epi64(_mm_shuffle_epi32(first, _MM_SHUFFLE(2, 0, 2, 0)),
+                                                      _mm_shuffle_epi32(second, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + column * 4), pixels);
+        }
+    }
+    else if (bytesPerPixel == 1) {
+        // The even bytes are the low bytes of the 16 bit lanes, packus narrows them back to bytes.
+        const __m128i mask = _mm_set1_epi16(0x00ff);
+        for (; column + 16 <= width; column += 16) {
+            const __m128i first = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(source + column * 2)), mask);
+            const __m128i second = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(source + column * 2 + 16)), mask);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + column), _mm_packus_epi16(first, second));
+        }
+    }
+    // SSE2 has no byte shuffle, so 3 byte pixels use the scalar loop.
+#elif defined(OFX_FFMPEG_NEON)
+    if (bytesPerPixel == 4) {
+        for (; column + 4 <= width; column += 4) {
+            const uint32x4x2_t pixels = vld2q_u32(reinterpret_cast<const uint32_t *>(source + column * 8));
+            vst1q_u32(reinterpret_cast<uint32_t *>(destination + column * 4), pixels.val[0]);
+        }
+    }
+    else if (bytesPerPixel == 3) {
+        // vld3 splits the channels, the even pixels of each channel are unzipped from two loads.
+        for (; column + 16 <= width; column += 16) {
+            const uint8x16x3_t first = vld3q_u8(source + column * 6);
+            const uint8x16x3_t second = vld3q_u8(source + column * 6 + 48);
+            uint8x16x3_t pixels;
+            pixels.val[0] = vuzpq_u8(first.val[0], second.val[0]).val[0];
+            pixels.val[1] = vuzpq_u8(first.val[1], second.val[1]).val[0];
+            pixels.val[2] = vuzpq_u8(first.val[2], second.val[2]).val[0];
+            vst3q_u8(destination + column * 3, pixels);
+        }
+    }
+    else if (bytesPerPixel == 1) {
+        for (; column + 16 <= width; column += 16) {
+            vst1q_u8(destination + column, vld2q_u8(source + column * 2).val[0]);
+        }
+    }
+#endif
+
+    for (; column < width; column++) {
+        memcpy(destination + column * bytesPerPixel, source + column * 2 * bytesPerPixel, bytesPerPixel);
+    }
+}
+}
+
+bool ofxFFmpegPixelsEqual(const ofPixels &first, const ofPixels &second)
+{
+    if (first.getWidth() != second.getWidth() || first.getHeight() != second.getHeight()
+        || first.getPixelFormat() != second.getPixelFormat() || first.getTotalBytes() != second.getTotalBytes()) {
+        return false;
+    }
+
+    return ofxFFmpegBytesEqual(first.getData(), second.getData(), first.getTotalBytes());
+}
+
+bool ofxFFmpegBytesEqual(const unsigned char *first, const unsigned char *second, size_t length)
+{
+    size_t i = 0;
+
+#if defined(OFX_FFMPEG_SSE2)
+    // 64 bytes per iteration, the differences of four registers are combined so there is one branch per iteration.
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 64 <= length; i += 64) {
+        const __m128i *a = reinterpret_cast<const __m128i *>(first + i);
+        const __m128i *b = reinterpret_cast<const __m128i *>(second + i);
+        __m128i difference = _mm_xor_si128(_mm_loadu_si128(a), _mm_loadu_si128(b));
+        difference = _mm_or_si128(difference, _mm_xor_si128(_mm_loadu_si128(a + 1), _mm_loadu_si128(b + 1)));
+        difference = _mm_or_si128(difference, _mm_xor_si128(_mm_loadu_si128(a + 2), _mm_loadu_si128(b + 2)));
+        difference = _mm_or_si128(difference, _mm_xor_si128(_mm_loadu_si128(a + 3), _mm_loadu_si128(b + 3)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(difference, zero)) != 0xFFFF) {
+            return false;
+        }
+    }
+#elif defined(OFX_FFMPEG_NEON)
+    for (; i + 64 <= length; i += 64) {
+        uint8x16_t difference = veorq_u8(vld1q_u8(first + i), vld1q_u8(second + i));
+        difference = vorrq_u8(difference, veorq_u8(vld1q_u8(first + i + 16), vld1q_u8(second + i + 16)));
+        difference = vorrq_u8(difference, veorq_u8(vld1q_u8(first + i + 32), vld1q_u8(second + i + 32)));
+        difference = vorrq_u8(difference, veorq_u8(vld1q_u8(first + i + 48), vld1q_u8(second + i + 48)));
+        const uint64x2_t halves = vreinterpretq_u64_u8(difference);
+        if ((vgetq_lane_u64(halves, 0) | vgetq_lane_u64(halves, 1)) != 0) {
+            return false;
+        }
+    }
+#endif
+
+    return memcmp(first + i, second + i, length - i) == 0;
+}
+
+uint64_t ofxFFmpegAbsoluteDifference(const unsigned char *first, const unsigned char *second, size_t length)
+{
+    size_t i = 0;
+    uint64_t sum = 0;
+
+#if defined(OFX_FFMPEG_SSE2)
+    // psadbw sums the absolute differences of 8 bytes into each 64 bit half.
+    __m128i total = _mm_setzero_si128();
+    for (; i + 16 <= length; i += 16) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first + i));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(second + i));
+        total = _mm_add_epi64(total, _mm_sad_epu8(a, b));
+    }
+
+    uint64_t halves[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(halves), total);
+    sum = halves[0] + halves[1];
+#elif defined(OFX_FFMPEG_NEON)
+    // The 32 bit lanes hold up to 16 million iterations, far more than a row.
+    uint32x4_t total = vdupq_n_u32(0);
+    for (; i + 16 <= length; i += 16) {
+        const uint8x16_t difference = vabdq_u8(vld1q_u8(first + i), vld1q_u8(second + i));
+        total = vpadalq_u16(total, vpaddlq_u8(difference));
+    }
+
+    sum = static_cast<uint64_t>(vgetq_lane_u32(total, 0)) + vgetq_lane_u32(total, 1) + vgetq_lane_u32(total, 2) + vgetq_lane_u32(total, 3);
+#endif
+
+    for (; i < length; i++) {
+        sum += first[i] > second[i] ? first[i] - second[i] : second[i] - first[i];
+    }
+
+    return sum;
+}
+
+float ofxFFmpegSampledDifference(const ofPixels &source, size_t x, size_t y, size_t width, size_t height, size_t rowStep,
+                                 std::vector<unsigned char> &reference)
+{
+    rowStep = std::max<size_t>(rowStep, 1);
+    const size_t bytesPerPixel = source.getBytesPerPixel();
+    const size_t sourceStride = source.getBytesStride();
+    const size_t rowLength = width * bytesPerPixel;
+    const size_t rowCount = (height + rowStep - 1) / rowStep;
+    if (rowLength == 0 || rowCount == 0) {
+        return 0.f;
+    }
+
+    const bool hasReference = reference.size() == rowLength * rowCount;
+    if (hasReference == false) {
+        reference.resize(rowLength * rowCount);
+    }
+
+    uint64_t sum = 0;
+    const unsigned char *sourceRow = source.getData() + y * sourceStride + x * bytesPerPixel;
+    unsigned char *referenceRow = reference.data();
+    for (size_t row = 0; row < rowCount; row++) {
+        if (hasReference) {
+            sum += ofxFFmpegAbsoluteDifference(sourceRow, referenceRow, rowLength);
+        }
+
+        memcpy(referenceRow, sourceRow, rowLength);
+        sourceRow += sourceStride * rowStep;
+        referenceRow += rowLength;
+    }
+
+    return hasReference ? static_cast<float>(static_cast<double>(sum) / reference.size()) : 0.f;
+}
+
+void ofxFFmpegCopyRegion(const ofPixels &source, size_t x, size_t y, size_t width, size_t height, ofPixels &destination)
+{
+    destination.allocate(width, height, source.getPixelFormat());
+    ofxFFmpegCopyRegion(source, x, y, width, height, destination.getData());
+}
+
+void ofxFFmpegCopyRegion(const ofPixels &source, size_t x, size_t y, size_t width, size_t height, unsigned char *destination)
+{
+    const size_t bytesPerPixel = source.getBytesPerPixel();
+    const size_t sourceStride = source.getBytesStride();
+    const size_t rowLength = width * bytesPerPixel;
+    const unsigned char *sourceRow = source.getData() + y * sourceStride + x * bytesPerPixel;
+    unsigned char *destinationRow = destination;
+
+    if (rowLength == sourceStride) {
+        memcpy(destinationRow, sourceRow, rowLength * height);
+        return;
+    }
+
+    for (size_t row = 0; row < height; row++) {
+        memcpy(destinationRow, sourceRow, rowLength);
+        sourceRow += sourceStride;
+        destinationRow += rowLength;
+    }
+}
+
+bool ofxFFmpegCompressPixels(const ofPixels &pixels, std::vector<unsigned char> &compressed)
+{
+    const size_t channels = pixels.getBytesPerPixel();
+    if ((channels != 3 && channels != 4) || pixels.getNumChannels() != channels) {
+        return false;
+    }
+
+    const unsigned char *data = pixels.getData();
+    const size_t length = pixels.getTotalBytes();
+    compressed.clear();
+    compressed.reserve(length / 4);
+
+    QoiPixel index[64] = {};
+    QoiPixel previous = {0, 0, 0, 255};
+    unsigned char run = 0;
+    for (size_t offset = 0; offset < length; offset += channels) {
+        const QoiPixel pixel = {data[offset], data[offset + 1], data[offset + 2], channels == 4 ? data[offset + 3] : static_cast<unsigned char>(255)};
+        if (pixel == previous) {
+            run++;
+            if (run == 62 || offset + channels == length) {
+                compressed.push_back(QOI_OP_RUN | (run - 1));
+                run = 0;
+            }
+
+            continue;
+        }
+
+        if (run > 0) {
+            compressed.push_back(QOI_OP_RUN | (run - 1));
+            run = 0;
+        }
+
+        const size_t hash = qoiHash(pixel);
+        if (index[hash] == pixel) {
+            compressed.push_back(QOI_OP_INDEX | static_cast<unsigned char>(hash));
+        }
+        else {
+            index[hash] = pixel;
+            if (pixel.a == previous.a) {
+                const signed char dr = static_cast<signed char>(pixel.r - previous.r);
+                const signed char dg = static_cast<signed char>(pixel.g - previous.g);
+                const signed char db = static_cast<signed char>(pixel.b - previous.b);
+                const signed char drg = static_cast<signed char>(dr - dg);
+                const signed char dbg = static_cast<signed char>(db - dg);
+                if (dr > -3 && dr < 2 && dg > -3 && dg < 2 && db > -3 && db < 2) {
+                    compressed.push_back(QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+                }
+                else if (drg > -9 && drg < 8 && dg > -33 && dg < 32 && dbg > -9 && dbg < 8) {
+                    compressed.push_back(QOI_OP_LUMA | (dg + 32));
+                    compressed.push_back((drg + 8) << 4 | (dbg + 8));
+                }
+                else {
+                    compressed.insert(compressed.end(), {QOI_OP_RGB, pixel.r, pixel.g, pixel.b});
+                }
+            }
+            else {
+                compressed.insert(compressed.end(), {QOI_OP_RGBA, pixel.r, pixel.g, pixel.b, pixel.a});
+            }
+
+            // Frames that do not compress are given up on as early as possible.
+            if (compressed.size() >= length) {
+                return false;
+            }
+        }
+
+        previous = pixel;
+    }
+
+    return compressed.size() < length;
+}
+
+void ofxFFmpegDecompressPixels(const std::vector<unsigned char> &compressed, ofPixels &pixels)
+{
+    const size_t channels = pixels.getBytesPerPixel();
+    unsigned char *data = pixels.getData();
+    const size_t length = pixels.getTotalBytes();
+    const size_t size = compressed.size();
+
+    QoiPixel index[64] = {};
+    QoiPixel pixel = {0, 0, 0, 255};
+    size_t run = 0, position = 0;
+    for (size_t offset = 0; offset < length; offset += channels) {
+        if (run > 0) {
+            run--;
+        }
+        else if (position < size) {
+            const unsigned char op = compressed[position++];
+            if (op == QOI_OP_RGB && position + 3 <= size) {
+                pixel.r = compressed[position];
+                pixel.g = compressed[position + 1];
+                pixel.b = compressed[position + 2];
+                position += 3;
+            }
+            else if (op == QOI_OP_RGBA && position + 4 <= size) {
+                pixel.r = compressed[position];
+                pixel.g = compressed[position + 1];
+                pixel.b = compressed[position + 2];
+                pixel.a = compressed[position + 3];
+                position += 4;
+            }
+            else if ((op & QOI_MASK) == QOI_OP_INDEX) {
+                pixel = index[op];
+            }
+            else if ((op & QOI_MASK) == QOI_OP_DIFF) {
+                pixel.r += ((op >> 4) & 0x03) - 2;
+                pixel.g += ((op >> 2) & 0x03) - 2;
+                pixel.b += (op & 0x03) - 2;
+            }
+            else if ((op & QOI_MASK) == QOI_OP_LUMA && position < size) {
+                const unsigned char next = compressed[position++];
+                const int dg = (op & 0x3f) - 32;
+                pixel.r += dg - 8 + ((next >> 4) & 0x0f);
+                pixel.g += dg;
+                pixel.b += dg - 8 + (next & 0x0f);
+            }
+            else if ((op & QOI_MASK) == QOI_OP_RUN) {
+                run = op & 0x3f;
+            }
+
+            index[qoiHash(pixel)] = pixel;
+        }
+
+        data[offset] = pixel.r;
+        data[offset + 1] = pixel.g;
+        data[offset + 2] = pixel.b;
+        if (channels == 4) {
+            data[offset + 3] = pixel.a;
+        }
+    }
+}
+
+void ofxFFmpegBlit(const ofPixels &source, ofPixels &destination, size_t x, size_t y, size_t width, size_t height)
+{
+    if (width == 0 || height == 0 || source.getWidth() == 0 || source.getHeight() == 0) {
+        return;
+    }
+
+    const size_t bytesPerPixel = destination.getBytesPerPixel();
+    const size_t sourceStride = source.getBytesStride();
+    const size_t destinationStride = destination.getBytesStride();
+    unsigned char *destinationRow = destination.getData() + y * destinationStride + x * bytesPerPixel;
+
+    if (width == source.getWidth() && height == source.getHeight()) {
+        const unsigned char *sourceRow = source.getData();
+        for (size_t row = 0; row < height; row++) {
+            memcpy(destinationRow, sourceRow, width * bytesPerPixel);
+            sourceRow += sourceStride;
+            destinationRow += destinationStride;
+        }
+
+        return;
+    }
+
+    // The source offset of each destination column is computed once and used for every row.
+    std::vector<size_t> columnOffsets(width);
+    for (size_t column = 0; column < width; column++) {
+        columnOffsets[column] = (column * source.getWidth() / width) * bytesPerPixel;
+    }
+
+    // Halving the width, e.g. a video sized source in a 2x2 grid, has a vectorized path. Other ratios need a gather, which SSE2 and NEON
+    // don't have.
+    const bool isHalvingWidth = source.getWidth() == width * 2;
+    const unsigned char *previousSourceRow = nullptr;
+    for (size_t row = 0; row < height; row++) {
+        const unsigned char *sourceRow = source.getData() + (row * source.getHeight() / height) * sourceStride;
+        unsigned char *destinationPixel = destinationRow;
+        if (sourceRow == previousSourceRow) {
+            // When the height is scaled up, the rows that sample the same source row are copies of the previous one.
+            memcpy(destinationRow, destinationRow - destinationStride, width * bytesPerPixel);
+        }
+        else if (isHalvingWidth) {
+            decimateRow(sourceRow, destinationRow, width, bytesPerPixel);
+        }
+        else if (bytesPerPixel == 4) {
+            for (size_t column = 0; column < width; column++, destinationPixel += 4) {
+                memcpy(destinationPixel, sourceRow + columnOffsets[column], 4);
+            }
+        }
+        else if (bytesPerPixel == 1) {
+            for (size_t column = 0; column < width; column++) {
+                destinationPixel[column] = sourceRow[columnOffsets[column]];
+            }
+        }
+        else {
+            for (size_t column = 0; column < width; column++, destinationPixel += bytesPerPixel) {
+                memcpy(destinationPixel, sourceRow + columnOffsets[column], bytesPerPixel);
+            }
+        }
+
+        previousSourceRow = sourceRow;
+        destinationRow += destinationStride;
+    }
+}
+
+bool ofxFFmpegRegionEqual(const ofPixels &frame, const ofPixels &source, size_t x, size_t y)
+{
+    if (frame.getPixelFormat() != source.getPixelFormat() || x + frame.getWidth() > source.getWidth()
+        || y + frame.getHeight() > source.getHeight()) {
+        return false;
+    }
+
+    const size_t bytesPerPixel = source.getBytesPerPixel();
+    const size_t sourceStride = source.getBytesStride();
+    const size_t frameStride = frame.getBytesStride();
+    const unsigned char *sourceRow = source.getData() + y * sourceStride + x * bytesPerPixel;
+    const unsigned char *frameRow = frame.getData();
+
+    for (size_t row = 0; row < frame.getHeight(); row++) {
+        if (ofxFFmpegBytesEqual(frameRow, sourceRow, frameStride) == false) {
+            return false;
+        }
+
+        sourceRow += sourceStride;
+        frameRow += frameStride;
+    }
+
+    return true;
+}
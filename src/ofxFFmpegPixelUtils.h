@@ -0,0 +1,70 @@
+#pragma once
+
+#include "ofPixels.h"
+
+#include <vector>
+
+/**
+ * Pixel helpers used by ofxFFmpegRecorder on the render thread. They use SSE2 on x86 and NEON on ARM, and fall back to plain C++
+ * on the other platforms.
+ */
+
+/**
+ * @brief Returns true if both pixels have the same size, format and contents. This returns as soon as a difference is found, so
+ * comparing frames that changed is usually much cheaper than copying them.
+ */
+bool ofxFFmpegPixelsEqual(const ofPixels &first, const ofPixels &second);
+
+/**
+ * @brief Returns true if the first length bytes of first and second are the same.
+ */
+bool ofxFFmpegBytesEqual(const unsigned char *first, const unsigned char *second, size_t length);
+
+/**
+ * @brief Returns the sum of the absolute differences of the first length bytes of first and second.
+ */
+uint64_t ofxFFmpegAbsoluteDifference(const unsigned char *first, const unsigned char *second, size_t length);
+
+/**
+ * @brief Compares every rowStep-th row of the width x height region at x, y of source with the same rows in reference, and then copies
+ * the rows into reference. Returns the mean absolute difference per byte, from 0 to 255. If reference does not have the size of the
+ * rows, it is resized and 0 is returned. source must have a single plane and the region must be inside it.
+ */
+float ofxFFmpegSampledDifference(const ofPixels &source, size_t x, size_t y, size_t width, size_t height, size_t rowStep,
+                                 std::vector<unsigned char> &reference);
+
+/**
+ * @brief Copies the width x height region at x, y of source into destination, row by row with the stride of source. destination is
+ * allocated with the size of the region and the format of source, so it is not reallocated if it already has them. source must have
+ * a single plane and the region must be inside it.
+ */
+void ofxFFmpegCopyRegion(const ofPixels &source, size_t x, size_t y, size_t width, size_t height, ofPixels &destination);
+
+/**
+ * @brief Copies the region into destination, which must have room for width * height pixels of source.
+ */
+void ofxFFmpegCopyRegion(const ofPixels &source, size_t x, size_t y, size_t width, size_t height, unsigned char *destination);
+
+/**
+ * @brief Returns true if frame has the same format and contents as the region of source at x, y with the size of frame.
+ */
+bool ofxFFmpegRegionEqual(const ofPixels &frame, const ofPixels &source, size_t x, size_t y);
+
+/**
+ * @brief Compresses an RGB, BGR, RGBA or BGRA frame losslessly into compressed with a QOI-style encoding. It is fast enough to
+ * keep up with raw video on one core, and it works best for the flat areas and gradients of rendered frames. Returns false if the
+ * format is not supported, or if the compressed frame would not be smaller.
+ */
+bool ofxFFmpegCompressPixels(const ofPixels &pixels, std::vector<unsigned char> &compressed);
+
+/**
+ * @brief Decompresses a frame that was compressed with ofxFFmpegCompressPixels() into pixels, which must already be allocated with
+ * the size and the format of the compressed frame.
+ */
+void ofxFFmpegDecompressPixels(const std::vector<unsigned char> &compressed, ofPixels &pixels);
+
+/**
+ * @brief Copies source into the width x height region at x, y of destination. If the sizes are different, source is scaled with
+ * nearest neighbour sampling. Both pixels must have the same single plane format and the region must be inside destination.
+ */
+void ofxFFmpegBlit(const ofPixels &source, ofPixels &destination, size_t x, size_t y, size_t width, size_t height);
@@ -0,0 +1,64 @@
+#include "ofxFFmpegProcess.h"
+
+#include <mutex>
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+namespace
+{
+
+/**
+ * @brief Held while a pipe is created and while a process is started. A descriptor is only inheritable while its process is started.
+ */
+std::mutex &getProcessMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+}
+
+bool ofxFFmpegCreatePipe(int fds[2])
+{
+#if defined(_WIN32)
+    (void)fds;
+    return false;
+#else
+    // pipe2() is not available on macOS, so the flags are set under the lock instead.
+    std::lock_guard<std::mutex> lock(getProcessMutex());
+    if (pipe(fds) != 0) {
+        return false;
+    }
+
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+#endif
+}
+
+FILE *ofxFFmpegOpenProcess(const std::string &command, const char *mode, const std::vector<int> &inheritedDescriptors)
+{
+#if defined(_WIN32)
+    (void)inheritedDescriptors;
+    return _popen(command.c_str(), mode);
+#else
+    std::lock_guard<std::mutex> lock(getProcessMutex());
+    for (int fd : inheritedDescriptors) {
+        if (fd >= 0) {
+            fcntl(fd, F_SETFD, 0);
+        }
+    }
+
+    FILE *file = popen(command.c_str(), mode);
+    for (int fd : inheritedDescriptors) {
+        if (fd >= 0) {
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+    }
+
+    return file;
+#endif
+}
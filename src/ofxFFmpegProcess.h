@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * Process helpers used by ofxFFmpegRecorder. Every ffmpeg of the addon is started with ofxFFmpegOpenProcess(), so a pipe that is made
+ * for one ffmpeg is not inherited by another one that is started at the same time from another thread. If the pipe was inherited, its
+ * reader would not get EOF until the other ffmpeg exits.
+ */
+
+/**
+ * @brief Creates a pipe whose ends are not inherited by the processes that are started after it. Not available on Windows.
+ * @param fds The read and the write end, the same as pipe().
+ * @return Returns false if the pipe cannot be created.
+ */
+bool ofxFFmpegCreatePipe(int fds[2]);
+
+/**
+ * @brief Runs the command with popen(). Only this process inherits the given descriptors of ofxFFmpegCreatePipe(), negative ones are
+ * skipped. The descriptors are not inherited on Windows.
+ * @param command
+ * @param mode
+ * @param inheritedDescriptors
+ * @return Returns nullptr if the process cannot be started.
+ */
+FILE *ofxFFmpegOpenProcess(const std::string &command, const char *mode, const std::vector<int> &inheritedDescriptors = {});
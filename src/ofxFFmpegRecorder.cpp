@@ -3,6 +3,33 @@
 #include "ofLog.h"
 #include "ofVideoGrabber.h"
 #include "ofSoundStream.h"
+#include "ofImage.h"
+
+#include "ofxFFmpegPixelUtils.h"
+#include "ofxFFmpegProcess.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <cmath>
+#include <limits>
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#endif
+
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
 
 // Logging macros
 #define LOG_ERROR(message) ofLogError("") << __FUNCTION__ << ":" << __LINE__ << ": " << message
@@ -24,14 +51,69 @@ ofxFFmpegRecorder::ofxFFmpegRecorder()
     , m_bufferSize(1024)
     , m_sampleRate(44100)
     , m_CaptureDuration(0.f)
-    , m_TotalPauseDuration(0.f)
+    , m_TotalPauseDuration(0.0)
     , m_DefaultVideoDevice()
     , m_DefaultAudioDevice()
     , m_VideCodec("mpeg4")
     , m_AudioCodec("libmp3lame")
     , m_CustomRecordingFile(nullptr)
     , m_DefaultRecordingFile(nullptr)
+    , m_FramePool(std::make_shared<ofxFFmpegFramePool>())
+    , m_WrittenVideoFrames(0)
+    , m_HasLiveThumbnails(false)
+    , m_IsLiveThumbnailRunning(false)
+    , m_IsCustomRecording(false)
+    , m_IsCancelled(false)
+    , m_IsInWriterPool(false)
+    , m_PooledFrameOffset(0)
+    , m_WriterThreadPriority(0)
+    , m_EncoderNiceLevel(0)
+    , m_EncoderThreads(0)
+    , m_IsFragmentedOutput(false)
+    , m_FragmentDuration(1.f)
+    , m_TimeScale(1.f)
+    , m_TimelapseInterval(0.f)
+    , m_IsOffline(false)
+    , m_OfflineMaxQueuedFrames(8)
+    , m_ChunkedProcessCount(1)
+    , m_ChunkFrames(120)
+    , m_IsLadderRecording(false)
+    , m_NextSequence(0)
+    , m_MaxReorderedFrames(16)
+    , m_IsSkippingStaticFrames(false)
+    , m_IsVariableFrameRate(false)
+    , m_UnwrittenFrames(0)
+    , m_MotionThreshold(0.f)
+    , m_MotionPreRoll(2.f)
+    , m_MotionPostRoll(5.f)
+    , m_MotionRowStep(4)
+    , m_MotionLevel(0.f)
+    , m_IsMotionActive(false)
+    , m_LastMotionTime(-std::numeric_limits<double>::infinity())
+    , m_MotionFrameCount(0)
+    , m_MotionPtsOffset(0)
+    , m_IsCompressingQueuedFrames(false)
+    , m_CompressionThreshold(4)
+    , m_IsCompressionRunning(false)
+    , m_QueueMemoryBudget(0)
+    , m_SpillFileSize(0)
+    , m_IsSpillFileFailed(false)
+    , m_AdaptiveLevel(0)
+    , m_AdaptiveLoad(0)
+    , m_ProgressGeneration(0)
+    , m_PreviewSize(0, 0)
+    , m_PreviewFps(10.f)
+    , m_PreviewFrameCount(0)
+    , m_LastPreviewFrame(0)
+    , m_IsWritingKeyframeIndex(false)
 {
+    m_ProgressPipe[0] = -1;
+    m_ProgressPipe[1] = -1;
+    m_PreviewPipe[0] = -1;
+    m_PreviewPipe[1] = -1;
+    m_KeyframeIndexPipe[0] = -1;
+    m_KeyframeIndexPipe[1] = -1;
+    resetStats();
 
 }
 
@@ -51,7 +133,268 @@ void ofxFFmpegRecorder::setup(bool recordVideo, bool recordAudio, glm::vec2 vide
 
     if (ffmpegPath.length() > 0) {
         m_FFmpegPath = ffmpegPath;
+        m_Capabilities = nullptr;
+    }
+}
+
+const std::vector<int> &ofxFFmpegRecorder::getWriterThreadAffinity() const
+{
+    return m_WriterThreadAffinity;
+}
+
+void ofxFFmpegRecorder::setWriterThreadAffinity(const std::vector<int> &cpus)
+{
+    if (isRecording()) {
+        LOG_NOTICE("A recording is in proggress. The change will take effect for the next recording session.");
+    }
+
+    m_WriterThreadAffinity = cpus;
+}
+
+int ofxFFmpegRecorder::getWriterThreadPriority() const
+{
+    return m_WriterThreadPriority;
+}
+
+void ofxFFmpegRecorder::setWriterThreadPriority(int priority)
+{
+    if (isRecording()) {
+        LOG_NOTICE("A recording is in proggress. The change will take effect for the next recording session.");
+    }
+
+    m_WriterThreadPriority = priority;
+}
+
+int ofxFFmpegRecorder::getEncoderNiceLevel() const
+{
+    return m_EncoderNiceLevel;
+}
+
+void ofxFFmpegRecorder::setEncoderNiceLevel(int level)
+{
+    if (isRecording()) {
+        LOG_NOTICE("A recording is in proggress. The change will take effect for the next recording session.");
+    }
+
+    m_EncoderNiceLevel = level;
+}
+
+const std::vector<int> &ofxFFmpegRecorder::getEncoderCpuSet() const
+{
+    return m_EncoderCpuSet;
+}
+
+void ofxFFmpegRecorder::setEncoderCpuSet(const std::vector<int> &cpus)
+{
+    if (isRecording()) {
+        LOG_NOTICE("A recording is in proggress. The change will take effect for the next recording session.");
+    }
+
+    m_EncoderCpuSet = cpus;
+}
+
+unsigned int ofxFFmpegRecorder::getEncoderThreads() const
+{
+    return m_EncoderThreads;
+}
+
+void ofxFFmpegRecorder::setEncoderThreads(unsigned int threads)
+{
+    if (isRecording()) {
+        LOG_NOTICE("A recording is in proggress. The change will take effect for the next recording session.");
+    }
+
+    m_EncoderThreads = threads;
+}
+
+const ofxFFmpegStreamSettings &ofxFFmpegRecorder::getStreamSettings() const
+{
+    return m_StreamSettings;
+}
+
+void ofxFFmpegRecorder::setStreamSettings(const ofxFFmpegStreamSettings &settings)
+{
+    if (isRecording()) {
+        LOG_NOTICE("A recording is in proggress. The change will take effect for the next recording session.");
+    }
+
+    m_StreamSettings = settings;
+}
+
+const ofxFFmpegLadderSettings &ofxFFmpegRecorder::getLadderSettings() const
+{
+    return m_LadderSettings;
+}
+
+void ofxFFmpegRecorder::setLadderSettings(const ofxFFmpegLadderSettings &settings)
+{
+    if (isRecording()) {
+        LOG_NOTICE("A recording is in proggress. The change will take effect for the next recording session.");
+    }
+
+    m_LadderSettings = settings;
+    m_LadderSettings.segmentDuration = std::max(m_LadderSettings.segmentDuration, 0.1f);
+}
+
+std::string ofxFFmpegRecorder::getLadderPlaylistPath() const
+{
+    const std::string name = m_LadderSettings.format == OFX_FFMPEG_LADDER_DASH ? "manifest.mpd" : "master.m3u8";
+    return ofFilePath::join(m_LadderSettings.directory, name);
+}
+
+const ofxFFmpegAdaptiveSettings &ofxFFmpegRecorder::getAdaptiveSettings() const
+{
+    return m_AdaptiveSettings;
+}
+
+void ofxFFmpegRecorder::setAdaptiveSettings(const ofxFFmpegAdaptiveSettings &settings)
+{
+    if (isRecording()) {
+        LOG_NOTICE("A recording is in proggress. The change will take effect for the next recording session.");
+    }
+
+    m_AdaptiveSettings = settings;
+}
+
+bool ofxFFmpegRecorder::isFragmentedOutput() const
+{
+    return m_IsFragmentedOutput;
+}
+
+float ofxFFmpegRecorder::getFragmentDuration() const
+{
+    return m_FragmentDuration;
+}
+
+void ofxFFmpegRecorder::setFragmentedOutput(bool fragmented, float fragmentDuration)
+{
+    if (isRecording()) {
+        LOG_NOTICE("A recording is in proggress. The change will take effect for the next recording session.");
+    }
+
+    if (fragmentDuration <= 0.f) {
+        LOG_ERROR("The fragment duration must be positive.");
+        return;
+    }
+
+    m_IsFragmentedOutput = fragmented;
+    m_FragmentDuration = fragmentDuration;
+}
+
+bool ofxFFmpegRecorder::isWritingKeyframeIndex() const
+{
+    return m_IsWritingKeyframeIndex;
+}
+
+void ofxFFmpegRecorder::setWritingKeyframeIndex(bool writing)
+{
+    if (isRecording()) {
+        LOG_NOTICE("A recording is in proggress. The change will take effect for the next recording session.");
+    }
+
+    m_IsWritingKeyframeIndex = writing;
+}
+
+bool ofxFFmpegRecorder::isSkippingStaticFrames() const
+{
+    return m_IsSkippingStaticFrames;
+}
+
+bool ofxFFmpegRecorder::isVariableFrameRate() const
+{
+    return m_IsVariableFrameRate;
+}
+
+void ofxFFmpegRecorder::setSkippingStaticFrames(bool skip, bool variableFrameRate)
+{
+    if (isRecording() && variableFrameRate != m_IsVariableFrameRate) {
+        LOG_NOTICE("A recording is in proggress. The change will take effect for the next recording session.");
+    }
+
+    m_IsSkippingStaticFrames = skip;
+    m_IsVariableFrameRate = variableFrameRate;
+    if (skip == false) {
+        m_LastFrame.reset();
+    }
+}
+
+float ofxFFmpegRecorder::getMotionThreshold() const
+{
+    return m_MotionThreshold;
+}
+
+float ofxFFmpegRecorder::getMotionPreRoll() const
+{
+    return m_MotionPreRoll;
+}
+
+float ofxFFmpegRecorder::getMotionPostRoll() const
+{
+    return m_MotionPostRoll;
+}
+
+void ofxFFmpegRecorder::setMotionTrigger(float threshold, float preRoll, float postRoll, size_t rowStep)
+{
+    m_MotionThreshold = std::max(threshold, 0.f);
+    m_MotionPreRoll = std::max(preRoll, 0.f);
+    m_MotionPostRoll = std::max(postRoll, 0.f);
+    m_MotionRowStep = std::max<size_t>(rowStep, 1);
+    if (m_MotionThreshold == 0.f) {
+        resetMotionTrigger();
+    }
+}
+
+bool ofxFFmpegRecorder::isMotionActive() const
+{
+    return m_IsMotionActive;
+}
+
+float ofxFFmpegRecorder::getMotionLevel() const
+{
+    return m_MotionLevel;
+}
+
+bool ofxFFmpegRecorder::isCompressingQueuedFrames() const
+{
+    return m_IsCompressingQueuedFrames;
+}
+
+size_t ofxFFmpegRecorder::getCompressionThreshold() const
+{
+    return m_CompressionThreshold;
+}
+
+void ofxFFmpegRecorder::setCompressingQueuedFrames(bool compress, size_t queuedFramesThreshold)
+{
+    m_IsCompressingQueuedFrames = compress;
+    m_CompressionThreshold = queuedFramesThreshold;
+}
+
+size_t ofxFFmpegRecorder::getQueueMemoryBudget() const
+{
+    return m_QueueMemoryBudget;
+}
+
+void ofxFFmpegRecorder::setQueueMemoryBudget(size_t budgetBytes, size_t spillFileBytes, const std::string &spillPath)
+{
+    if (isRecording()) {
+        LOG_NOTICE("A recording is in proggress. The change will take effect for the next recording session.");
     }
+
+    m_QueueMemoryBudget = budgetBytes;
+    m_SpillFileSize = spillFileBytes;
+    m_SpillPath = spillPath;
+}
+
+size_t ofxFFmpegRecorder::getAdaptiveLevel() const
+{
+    return m_AdaptiveLevel;
+}
+
+std::vector<std::string> ofxFFmpegRecorder::getSegmentPaths() const
+{
+    std::lock_guard<std::mutex> lock(m_SegmentMutex);
+    return m_SegmentPaths;
 }
 
 void ofxFFmpegRecorder::setAudioConfig(int bufferSize, int sampleRate){
@@ -99,6 +442,7 @@ void ofxFFmpegRecorder::setFFmpegPath(const std::string &path)
     }
 
     m_FFmpegPath = path;
+    m_Capabilities = nullptr;
 }
 
 void ofxFFmpegRecorder::setFFmpegPathToAddonsPath() {
@@ -110,6 +454,83 @@ void ofxFFmpegRecorder::setFFmpegPathToAddonsPath() {
     systemFolder = "osx";
     #endif
     m_FFmpegPath = ofToDataPath("../../../../../addons/ofxFFmpegRecorder/libs/ffmpeg/lib/"+systemFolder+"/ffmpeg", true);
+    m_Capabilities = nullptr;
+}
+
+std::shared_ptr<const ofxFFmpegCapabilities> ofxFFmpegRecorder::getCapabilities()
+{
+    if (m_Capabilities == nullptr && m_CapabilitiesProbe.valid()) {
+        std::shared_ptr<const ofxFFmpegCapabilities> capabilities = m_CapabilitiesProbe.get();
+        if (m_CapabilitiesProbePath == m_FFmpegPath) {
+            m_Capabilities = capabilities;
+        }
+    }
+
+    if (m_Capabilities == nullptr) {
+        m_Capabilities = ofxFFmpegCapabilities::probe(m_FFmpegPath);
+    }
+
+    return m_Capabilities;
+}
+
+std::shared_ptr<const ofxFFmpegCapabilities> ofxFFmpegRecorder::getKnownCapabilities()
+{
+    if (m_Capabilities == nullptr && m_CapabilitiesProbe.valid()
+        && m_CapabilitiesProbe.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        std::shared_ptr<const ofxFFmpegCapabilities> capabilities = m_CapabilitiesProbe.get();
+        if (m_CapabilitiesProbePath == m_FFmpegPath) {
+            m_Capabilities = capabilities;
+        }
+    }
+
+    if (m_Capabilities == nullptr) {
+        m_Capabilities = ofxFFmpegCapabilities::find(m_FFmpegPath);
+    }
+
+    return m_Capabilities;
+}
+
+std::string ofxFFmpegRecorder::findEncoder(const std::shared_ptr<const ofxFFmpegCapabilities> &capabilities, const std::string &codec) const
+{
+    if (capabilities == nullptr || capabilities->isValid() == false || capabilities->hasEncoder(codec)) {
+        return codec;
+    }
+
+    return capabilities->getFastestEncoder(codec);
+}
+
+bool ofxFFmpegRecorder::canUseVariableFrameRate() const
+{
+    return m_IsSkippingStaticFrames && m_IsVariableFrameRate && m_IsOffline == false && m_ChunkedProcessCount <= 1;
+}
+
+bool ofxFFmpegRecorder::checkVideoCodec()
+{
+    const std::string encoder = findEncoder(getCapabilities(), m_VideCodec);
+    if (encoder.empty()) {
+        LOG_ERROR(m_FFmpegPath + " does not support the codec " + m_VideCodec + ". Cannot record.");
+        return false;
+    }
+
+    if (encoder != m_VideCodec) {
+        LOG_NOTICE("Using " + encoder + " for " + m_VideCodec + ".");
+        m_VideCodec = encoder;
+    }
+
+    return true;
+}
+
+void ofxFFmpegRecorder::probeCapabilities()
+{
+    if (m_Capabilities || (m_CapabilitiesProbe.valid() && m_CapabilitiesProbePath == m_FFmpegPath)) {
+        return;
+    }
+
+    // Replacing a probe of another path waits for it to finish.
+    m_CapabilitiesProbePath = m_FFmpegPath;
+    m_CapabilitiesProbe = std::async(std::launch::async, [path = m_FFmpegPath]() {
+        return ofxFFmpegCapabilities::probe(path);
+    });
 }
 
 float ofxFFmpegRecorder::getCaptureDuration() const
@@ -201,13 +622,25 @@ std::string ofxFFmpegRecorder::getVideoCodec() const
     return m_VideCodec;
 }
 
-void ofxFFmpegRecorder::setVideoCodec(const std::string &codec)
+bool ofxFFmpegRecorder::setVideoCodec(const std::string &codec)
 {
+    // The binary is not run here. If it is not probed yet, the codec is checked when the recording starts.
+    const std::string encoder = findEncoder(getKnownCapabilities(), codec);
+    if (encoder.empty()) {
+        LOG_ERROR(m_FFmpegPath + " does not support the codec " + codec + ". The codec is not changed.");
+        return false;
+    }
+
+    if (encoder != codec) {
+        LOG_NOTICE("Using " + encoder + " for " + codec + ".");
+    }
+
     if (isRecording()) {
         LOG_NOTICE("A recording is in proggress. The change will take effect for the next recording session.");
     }
 
-    m_VideCodec = codec;
+    m_VideCodec = encoder;
+    return true;
 }
 
 float ofxFFmpegRecorder::getWidth() {
@@ -230,7 +663,7 @@ bool ofxFFmpegRecorder::isPaused() const
 
 void ofxFFmpegRecorder::setPaused(bool paused)
 {
-    if (m_CustomRecordingFile == nullptr) {
+    if (isRecordingCustom() == false) {
         LOG_WARNING("Cannot pause the default webcam recording.");
     }
     else {
@@ -247,62 +680,137 @@ void ofxFFmpegRecorder::setPaused(bool paused)
     }
 }
 
-void ofxFFmpegRecorder::setPixelFormat(ofImageType aType)
+bool ofxFFmpegRecorder::setPixelFormat(ofImageType aType)
 {
-	mPixFmt = "rgb24";
+	std::string pixFmt = "rgb24";
 	if (aType == OF_IMAGE_COLOR) {
-		mPixFmt = "rgb24";
+		pixFmt = "rgb24";
 	}
 	else if (aType == OF_IMAGE_GRAYSCALE) {
-		mPixFmt = "gray";
+		pixFmt = "gray";
 	}
 	else {
 		ofLogError() << "unsupported format, setting to OF_IMAGE_COLOR";
 	}
+
+	mPixFmt = pixFmt;
+	return aType == OF_IMAGE_COLOR || aType == OF_IMAGE_GRAYSCALE;
 }
 
-float ofxFFmpegRecorder::getRecordedDuration() const
+bool ofxFFmpegRecorder::isOffline() const
 {
-    return m_AddedVideoFrames / m_Fps;
+    return m_IsOffline;
 }
 
-float ofxFFmpegRecorder::getRecordedAudioDuration(float afps) const
+size_t ofxFFmpegRecorder::getOfflineMaxQueuedFrames() const
 {
-    return m_AddedAudioFrames / afps;
+    return m_OfflineMaxQueuedFrames;
 }
 
-bool ofxFFmpegRecorder::record(float duration)
+void ofxFFmpegRecorder::setOffline(bool offline, size_t maxQueuedFrames)
 {
     if (isRecording()) {
-        LOG_ERROR("A recording is already in proggress.");
-        return false;
+        LOG_NOTICE("A recording is in proggress. The change will take effect for the next recording session.");
     }
 
-    if (m_OutputPath.length() == 0) {
-        LOG_ERROR("Output path is empty. Cannot record.");
-        return false;
-    }
+    m_IsOffline = offline;
+    m_OfflineMaxQueuedFrames = std::max<size_t>(maxQueuedFrames, 1);
+}
 
-    if (ofFile::doesFileExist(m_OutputPath, false) && m_IsOverWrite == false) {
-        LOG_ERROR("The output file already exists and overwriting is disabled. Cannot capture video.");
-        return false;
-    }
+size_t ofxFFmpegRecorder::getChunkedProcessCount() const
+{
+    return m_ChunkedProcessCount;
+}
 
-    determineDefaultDevices();
-    m_CaptureDuration = duration;
+size_t ofxFFmpegRecorder::getChunkFrames() const
+{
+    return m_ChunkFrames;
+}
 
-    std::vector<std::string> args;
+void ofxFFmpegRecorder::setChunkedEncoding(size_t processCount, size_t chunkFrames)
+{
+    if (isRecording()) {
+        LOG_NOTICE("A recording is in proggress. The change will take effect for the next recording session.");
+    }
 
-#if defined(_WIN32)
-    args.push_back("-f dshow");
-#elif defined(__APPLE__)
-    args.push_back("-f avfoundation");
-#else
-    args.push_back("-f v4l2");
-#endif // PLATFORM_CHECK
+    m_ChunkedProcessCount = std::max<size_t>(processCount, 1);
+    m_ChunkFrames = std::max<size_t>(chunkFrames, 1);
+}
 
-    if (m_CaptureDuration > 0.f) {
-        args.push_back("-t " + std::to_string(m_CaptureDuration));
+float ofxFFmpegRecorder::getTimeScale() const
+{
+    if (m_TimelapseInterval > 0.f) {
+        return 1.f / (m_TimelapseInterval * m_Fps);
+    }
+
+    return m_TimeScale;
+}
+
+void ofxFFmpegRecorder::setTimeScale(float scale)
+{
+    if (scale <= 0.f) {
+        LOG_ERROR("The time scale must be positive.");
+        return;
+    }
+
+    m_TimeScale = scale;
+    m_TimelapseInterval = 0.f;
+    rebasePacing();
+}
+
+float ofxFFmpegRecorder::getTimelapseInterval() const
+{
+    return m_TimelapseInterval;
+}
+
+void ofxFFmpegRecorder::setTimelapseInterval(float interval)
+{
+    m_TimelapseInterval = std::max(interval, 0.f);
+    rebasePacing();
+}
+
+float ofxFFmpegRecorder::getRecordedDuration() const
+{
+    return m_AddedVideoFrames / m_Fps;
+}
+
+float ofxFFmpegRecorder::getRecordedAudioDuration(float afps) const
+{
+    return m_AddedAudioFrames / afps;
+}
+
+bool ofxFFmpegRecorder::record(float duration)
+{
+    if (isRecording()) {
+        LOG_ERROR("A recording is already in proggress.");
+        return false;
+    }
+
+    if (m_OutputPath.length() == 0) {
+        LOG_ERROR("Output path is empty. Cannot record.");
+        return false;
+    }
+
+    if (ofFile::doesFileExist(m_OutputPath, false) && m_IsOverWrite == false) {
+        LOG_ERROR("The output file already exists and overwriting is disabled. Cannot capture video.");
+        return false;
+    }
+
+    determineDefaultDevices();
+    m_CaptureDuration = duration;
+
+    std::vector<std::string> args;
+
+#if defined(_WIN32)
+    args.push_back("-f dshow");
+#elif defined(__APPLE__)
+    args.push_back("-f avfoundation");
+#else
+    args.push_back("-f v4l2");
+#endif // PLATFORM_CHECK
+
+    if (m_CaptureDuration > 0.f) {
+        args.push_back("-t " + std::to_string(m_CaptureDuration));
     }
 
     std::string inputDevices;
@@ -322,12 +830,19 @@ bool ofxFFmpegRecorder::record(float duration)
     std::copy(m_AdditionalInputArguments.begin(), m_AdditionalInputArguments.end(), std::back_inserter(args));
     args.push_back("-i " + inputDevices);
 
+    // The preview is the first output so that the options of the recording, including the additional output arguments, do not apply to it.
+    openPreviewPipe(args);
+
     args.push_back("-b:v " + std::to_string(m_BitRate) + "k");
+    if (m_EncoderThreads > 0) {
+        args.push_back("-threads " + std::to_string(m_EncoderThreads));
+    }
+
     args.push_back(m_OutputPath);
 
     std::copy(m_AdditionalOutputArguments.begin(), m_AdditionalOutputArguments.end(), std::back_inserter(args));
 
-    std::string cmd = m_FFmpegPath + " ";
+    std::string cmd = getEncoderCommandPrefix() + m_FFmpegPath + " ";
     for (auto arg : args) {
         cmd += arg + " ";
     }
@@ -335,12 +850,51 @@ bool ofxFFmpegRecorder::record(float duration)
     #if defined(_WIN32)
     m_DefaultRecordingFile = _popen(cmd.c_str(), "w");
 #else
-    m_DefaultRecordingFile = popen(cmd.c_str(), "w");
+    m_DefaultRecordingFile = ofxFFmpegOpenProcess(cmd, "w", {m_PreviewPipe[1]});
 #endif
 
+    startPreviewReader();
+    return true;
+}
+
+glm::vec2 ofxFFmpegRecorder::getPreviewSize() const
+{
+    return m_PreviewSize;
+}
+
+float ofxFFmpegRecorder::getPreviewFps() const
+{
+    return m_PreviewFps;
+}
+
+void ofxFFmpegRecorder::setPreview(glm::vec2 size, float fps)
+{
+    if (isRecording()) {
+        LOG_NOTICE("A recording is in proggress. The change will take effect for the next recording session.");
+    }
+
+    m_PreviewSize = size;
+    m_PreviewFps = fps;
+}
+
+bool ofxFFmpegRecorder::getPreviewPixels(ofPixels &pixels)
+{
+    std::lock_guard<std::mutex> lock(m_PreviewMutex);
+    const uint64_t frame = m_PreviewFrameCount;
+    if (frame == m_LastPreviewFrame || m_PreviewPixels.isAllocated() == false) {
+        return false;
+    }
+
+    pixels = m_PreviewPixels;
+    m_LastPreviewFrame = frame;
     return true;
 }
 
+uint64_t ofxFFmpegRecorder::getPreviewFrameCount() const
+{
+    return m_PreviewFrameCount;
+}
+
 bool ofxFFmpegRecorder::startCustomRecord()
 {
     if (isRecording()) {
@@ -348,6 +902,10 @@ bool ofxFFmpegRecorder::startCustomRecord()
         return false;
     }
 
+    if (m_LadderSettings.renditions.empty() == false) {
+        return startLadderRecord();
+    }
+
     if (m_OutputPath.length() == 0) {
         LOG_ERROR("Output path is empty. Cannot record.");
         return false;
@@ -358,7 +916,107 @@ bool ofxFFmpegRecorder::startCustomRecord()
         return false;
     }
 
+    if (checkVideoCodec() == false) {
+        return false;
+    }
+
     m_AddedVideoFrames = 0;
+    m_WrittenVideoFrames = 0;
+    resetStats();
+
+    m_AdaptiveLevel = 0;
+    m_AdaptiveLoadStart = std::chrono::high_resolution_clock::now();
+    m_AdaptiveLevelStart = m_AdaptiveLoadStart;
+    m_AdaptiveLoad = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_SegmentMutex);
+        m_SegmentPaths.assign(1, m_OutputPath);
+    }
+
+    if (m_ChunkedProcessCount > 1) {
+        if (m_AdaptiveSettings.levels.size() > 1) {
+            LOG_WARNING("Adaptive encoding is not supported with the chunked encoding. The first level is used for the whole recording.");
+        }
+
+        if (m_IsWritingKeyframeIndex) {
+            LOG_WARNING("The keyframe index is not written with the chunked encoding.");
+        }
+
+        // The command is the same for every chunk except for the output path.
+        std::string command = getEncoderCommandPrefix() + m_FFmpegPath + " ";
+        for (const std::string &arg : getCustomRecordArguments(m_OutputPath)) {
+            command += arg + " ";
+        }
+
+        m_FrameSink = std::make_shared<ofxFFmpegChunkedSink>(m_ChunkedProcessCount, m_ChunkFrames, m_OutputPath, m_FFmpegPath,
+                                                             [command](const std::string &chunkPath) {
+            return command + chunkPath;
+        });
+        m_IsCustomRecording = true;
+        return true;
+    }
+
+    m_RecordCommand = getCustomRecordCommand(m_OutputPath);
+    openCustomRecordPipe(m_OutputPath, 0);
+    if (m_CustomRecordingFile) {
+        m_IsCustomRecording = true;
+    }
+
+    return true;
+}
+
+void ofxFFmpegRecorder::openCustomRecordPipe(const std::string &outputPath, size_t level)
+{
+    const CustomRecordCommand &command = m_RecordCommand;
+    std::vector<std::string> args;
+    openProgressPipe(args);
+
+    const bool isIndexed = openKeyframeIndexPipe(outputPath);
+    level = std::min(level, command.levelArguments.size() - 1);
+    const std::vector<std::string> &recordArgs = isIndexed ? command.teeLevelArguments[level] : command.levelArguments[level];
+    args.insert(args.end(), recordArgs.begin(), recordArgs.end());
+    if (isIndexed) {
+        // The encoded packets go to both the file and a framecrc output that lists them. The muxer options are given to the file's
+        // output of the tee, and a failure of the index output does not stop the recording.
+        std::string options;
+        for (const auto &option : command.muxerOptions) {
+            options += (options.empty() ? "" : ":") + option.first + "=" + option.second;
+        }
+
+        args.push_back("-map 0:v");
+        args.push_back("-f tee");
+        args.push_back("\"" + (options.empty() ? "" : "[" + options + "]") + outputPath + "|[f=framecrc:onfail=ignore]pipe:"
+                       + std::to_string(m_KeyframeIndexPipe[1]) + "\"");
+    }
+    else {
+        args.push_back(outputPath);
+    }
+
+    std::string cmd = command.program + " ";
+    for (auto arg : args) {
+        cmd += arg + " ";
+    }
+
+#if defined(_WIN32)
+    m_CustomRecordingFile = _popen(cmd.c_str(), "wb");
+#else
+    m_CustomRecordingFile = ofxFFmpegOpenProcess(cmd, "w", {m_ProgressPipe[1], m_KeyframeIndexPipe[1]});
+#endif // _WIN32
+
+    if (m_CustomRecordingFile) {
+        m_FrameSink = std::make_shared<ofxFFmpegPipeSink>(m_CustomRecordingFile);
+    }
+
+    startProgressReader();
+    startKeyframeIndexReader();
+}
+
+std::vector<std::string> ofxFFmpegRecorder::getCustomRecordArguments(const std::string &outputPath, bool includeMuxerOptions,
+                                                                     size_t levelIndex) const
+{
+    const bool isAdaptive = levelIndex < m_AdaptiveSettings.levels.size();
+    const ofxFFmpegAdaptiveLevel level = isAdaptive ? m_AdaptiveSettings.levels[levelIndex] : ofxFFmpegAdaptiveLevel();
+    const float fps = m_Fps * level.fpsScale;
 
     std::vector<std::string> args;
     std::copy(m_AdditionalInputArguments.begin(), m_AdditionalInputArguments.end(), std::back_inserter(args));
@@ -366,7 +1024,15 @@ bool ofxFFmpegRecorder::startCustomRecord()
 	//args.push_back("-pix_fmts");
     args.push_back("-y");
     args.push_back("-an");
-    args.push_back("-r " + std::to_string(m_Fps));
+    const bool isVariableFrameRate = canUseVariableFrameRate();
+    if (isVariableFrameRate) {
+        // The input rate would replace the timestamps, so the frames are stamped with the time that ffmpeg reads them instead.
+        args.push_back("-use_wallclock_as_timestamps 1");
+    }
+    else {
+        args.push_back("-r " + std::to_string(m_Fps));
+    }
+
     args.push_back("-framerate " + std::to_string(m_Fps));
     args.push_back("-s " + std::to_string(static_cast<unsigned int>(m_VideoSize.x)) + "x" + std::to_string(static_cast<unsigned int>(m_VideoSize.y)));
     args.push_back("-f rawvideo");
@@ -377,72 +1043,146 @@ bool ofxFFmpegRecorder::startCustomRecord()
     
 
     args.push_back("-vcodec " + m_VideCodec);
-    args.push_back("-b:v " + std::to_string(m_BitRate) + "k");
-    args.push_back("-r " + std::to_string(m_Fps));
-    args.push_back("-framerate " + std::to_string(m_Fps));
+    if (level.preset.length() > 0) {
+        args.push_back("-preset " + level.preset);
+    }
+
+    if (level.crf >= 0) {
+        args.push_back("-crf " + std::to_string(level.crf));
+    }
+    else {
+        args.push_back("-b:v " + std::to_string(static_cast<unsigned int>(m_BitRate * level.bitRateScale)) + "k");
+    }
+
+    args.push_back("-r " + std::to_string(fps));
+    args.push_back("-framerate " + std::to_string(fps));
+    std::vector<std::string> filters;
+    if (isVariableFrameRate) {
+        // The frames that were not written are filled with repeats of the previous frame.
+        filters.push_back("fps=" + std::to_string(fps));
+    }
+
+    if (level.sizeScale != 1.f) {
+        // The size is kept even because most encoders require it for the chroma subsampled pixel formats.
+        const std::string scale = std::to_string(level.sizeScale);
+        filters.push_back("scale=trunc(iw*" + scale + "/2)*2:trunc(ih*" + scale + "/2)*2");
+    }
+
+    if (filters.empty() == false) {
+        args.push_back("-vf \"" + ofJoinString(filters, ",") + "\"");
+    }
+
+    if (m_EncoderThreads > 0) {
+        args.push_back("-threads " + std::to_string(m_EncoderThreads));
+    }
+
+    if (m_IsFragmentedOutput) {
+        // Every fragment starts with a keyframe so that it can be decoded without the previous ones.
+        const std::string duration = std::to_string(m_FragmentDuration);
+        args.push_back("-force_key_frames \"expr:gte(t,n_forced*" + duration + ")\"");
+    }
+
+    if (includeMuxerOptions) {
+        for (const auto &option : getMuxerOptions(outputPath)) {
+            args.push_back("-" + option.first + " " + option.second);
+        }
+    }
+
     std::copy(m_AdditionalOutputArguments.begin(), m_AdditionalOutputArguments.end(), std::back_inserter(args));
-    
-    args.push_back(m_OutputPath);
-//    args.push_back("-codecs ");
+    return args;
+}
 
-    std::string cmd = m_FFmpegPath + " ";
-    for (auto arg : args) {
-        cmd += arg + " ";
+ofxFFmpegRecorder::CustomRecordCommand ofxFFmpegRecorder::getCustomRecordCommand(const std::string &outputPath) const
+{
+    CustomRecordCommand command;
+    command.program = getEncoderCommandPrefix() + m_FFmpegPath;
+    command.muxerOptions = getMuxerOptions(outputPath);
+    command.adaptiveSettings = m_AdaptiveSettings;
+    command.isWritingKeyframeIndex = m_IsWritingKeyframeIndex;
+    command.isVariableFrameRate = canUseVariableFrameRate();
+    command.fps = m_Fps;
+
+    // The segments of the adaptive encoding share the extension of the output path, so their muxer options are the same.
+    const size_t levelCount = std::max<size_t>(m_AdaptiveSettings.levels.size(), 1);
+    for (size_t level = 0; level < levelCount; level++) {
+        command.levelArguments.push_back(getCustomRecordArguments(outputPath, true, level));
+        command.teeLevelArguments.push_back(getCustomRecordArguments(outputPath, false, level));
     }
 
-#if defined(_WIN32)
-    m_CustomRecordingFile = _popen(cmd.c_str(), "wb");
-#else
-//    m_CustomRecordingFile = _popen(cmd.c_str(), "w");
-    m_CustomRecordingFile = popen( cmd.c_str(), "w" );
-#endif // _WIN32
+    return command;
+}
 
-    return true;
+std::vector<std::pair<std::string, std::string>> ofxFFmpegRecorder::getMuxerOptions(const std::string &outputPath) const
+{
+    std::vector<std::pair<std::string, std::string>> options;
+    if (m_IsFragmentedOutput) {
+        const std::string extension = ofToLower(ofFilePath::getFileExt(outputPath));
+        if (extension == "mp4" || extension == "mov" || extension == "m4v") {
+            // The moov atom is written empty at the start and each fragment carries its own index, so nothing is rewritten at the end.
+            options.push_back({"movflags", "+frag_keyframe+empty_moov+default_base_moof"});
+            options.push_back({"frag_duration", std::to_string(static_cast<int64_t>(m_FragmentDuration * 1000000))});
+        }
+        else if (extension == "mkv" || extension == "webm") {
+            options.push_back({"cluster_time_limit", std::to_string(static_cast<int64_t>(m_FragmentDuration * 1000))});
+        }
+    }
+
+    return options;
 }
 
-bool ofxFFmpegRecorder::startCustomAudioRecord()
+bool ofxFFmpegRecorder::startLadderRecord()
 {
-    if (isRecording()) {
-        LOG_ERROR("A recording is already in proggress.");
+    const ofxFFmpegLadderSettings &settings = m_LadderSettings;
+    if (settings.directory.length() == 0) {
+        LOG_ERROR("The ladder directory is empty. Cannot record.");
         return false;
     }
 
-    if (m_OutputPath.length() == 0) {
-        LOG_ERROR("Output path is empty. Cannot record.");
+    if (m_IsWritingKeyframeIndex) {
+        LOG_WARNING("The keyframe index is not written with the rendition ladder.");
+    }
+
+    const std::string playlistPath = getLadderPlaylistPath();
+    if (ofFile::doesFileExist(playlistPath, false) && m_IsOverWrite == false) {
+        LOG_ERROR("The playlist already exists and overwriting is disabled. Cannot capture video.");
         return false;
     }
 
-    if (ofFile::doesFileExist(m_OutputPath, false) && m_IsOverWrite == false) {
-        LOG_ERROR("The output file already exists and overwriting is disabled. Cannot capture audio.");
+    if (checkVideoCodec() == false) {
         return false;
     }
 
-    m_AddedAudioFrames = 0;
+    std::vector<std::string> directories(1, settings.directory);
+    if (settings.format == OFX_FFMPEG_LADDER_HLS) {
+        for (size_t index = 0; index < settings.renditions.size(); index++) {
+            directories.push_back(ofFilePath::join(settings.directory, "stream_" + std::to_string(index)));
+        }
+    }
 
-    std::vector<std::string> args;
-    std::copy(m_AdditionalInputArguments.begin(), m_AdditionalInputArguments.end(), std::back_inserter(args));
+    for (const std::string &directory : directories) {
+        if (ofDirectory::doesDirectoryExist(directory, false) == false && ofDirectory::createDirectory(directory, false, true) == false) {
+            LOG_ERROR("Cannot create " + directory + ". Cannot record.");
+            return false;
+        }
+    }
 
-    // audio input config
-    args.push_back("-y");
-    args.push_back("-vn");
-    args.push_back("-r " + std::to_string(m_sampleRate));
-    args.push_back("-f f32le");
-    //args.push_back("-acodec aac");
-    args.push_back("-ac 1");
-    args.push_back("-i -");
+    m_AddedVideoFrames = 0;
+    m_WrittenVideoFrames = 0;
+    resetStats();
 
+    m_AdaptiveLevel = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_SegmentMutex);
+        m_SegmentPaths.assign(1, playlistPath);
+    }
 
-    // audio export file config
-    args.push_back("-acodec " + m_AudioCodec);
-    args.push_back("-f mp3");
-    args.push_back("-ar " + std::to_string(m_sampleRate));
-    args.push_back("-ac 1");
-    args.push_back("-b:a 320k");
-    std::copy(m_AdditionalOutputArguments.begin(), m_AdditionalOutputArguments.end(), std::back_inserter(args));
+    std::vector<std::string> args;
+    openProgressPipe(args);
 
-    args.push_back(m_OutputPath);
+    const std::vector<std::string> ladderArgs = getLadderArguments();
+    args.insert(args.end(), ladderArgs.begin(), ladderArgs.end());
 
-    std::string cmd = m_FFmpegPath + " ";
+    std::string cmd = getEncoderCommandPrefix() + m_FFmpegPath + " ";
     for (auto arg : args) {
         cmd += arg + " ";
     }
@@ -450,25 +1190,29 @@ bool ofxFFmpegRecorder::startCustomAudioRecord()
 #if defined(_WIN32)
     m_CustomRecordingFile = _popen(cmd.c_str(), "wb");
 #else
-    m_CustomRecordingFile = popen( cmd.c_str(), "w" );
+    m_CustomRecordingFile = ofxFFmpegOpenProcess(cmd, "w", {m_ProgressPipe[1]});
 #endif // _WIN32
 
+    if (m_CustomRecordingFile) {
+        m_FrameSink = std::make_shared<ofxFFmpegPipeSink>(m_CustomRecordingFile);
+        m_IsCustomRecording = true;
+        m_IsLadderRecording = true;
+    }
+
+    startProgressReader();
     return true;
 }
 
-bool ofxFFmpegRecorder::startCustomStreaming()
+std::vector<std::string> ofxFFmpegRecorder::getLadderArguments() const
 {
-    if (isRecording()) {
-        LOG_ERROR("A recording is already in proggress.");
-        return false;
-    }
-
-    m_AddedVideoFrames = 0;
-    m_AddedAudioFrames = 0;
+    const ofxFFmpegLadderSettings &settings = m_LadderSettings;
+    const size_t count = settings.renditions.size();
 
     std::vector<std::string> args;
     std::copy(m_AdditionalInputArguments.begin(), m_AdditionalInputArguments.end(), std::back_inserter(args));
 
+    args.push_back("-y");
+    args.push_back("-an");
     args.push_back("-framerate " + std::to_string(m_Fps));
     args.push_back("-s " + std::to_string(static_cast<unsigned int>(m_VideoSize.x)) + "x" + std::to_string(static_cast<unsigned int>(m_VideoSize.y)));
     args.push_back("-f rawvideo");
@@ -476,103 +1220,1738 @@ bool ofxFFmpegRecorder::startCustomStreaming()
     args.push_back("-vcodec rawvideo");
     args.push_back("-i -");
 
-    args.push_back("-b:v " + std::to_string(m_BitRate) + "k");
-    std::copy(m_AdditionalOutputArguments.begin(), m_AdditionalOutputArguments.end(), std::back_inserter(args));
+    // The input is read and converted once, and each branch of the split only scales its copy.
+    std::string graph = "[0:v]split=" + std::to_string(count);
+    for (size_t index = 0; index < count; index++) {
+        graph += "[v" + std::to_string(index) + "]";
+    }
 
-    args.push_back("-f rtp rtp://127.0.0.1:1234");
+    for (size_t index = 0; index < count; index++) {
+        const glm::vec2 &size = settings.renditions[index].size;
+        // -2 keeps the aspect ratio and rounds the calculated side to an even number.
+        const std::string width = size.x > 0 ? std::to_string(static_cast<unsigned int>(size.x)) : (size.y > 0 ? "-2" : "iw");
+        const std::string height = size.y > 0 ? std::to_string(static_cast<unsigned int>(size.y)) : (size.x > 0 ? "-2" : "ih");
+        graph += ";[v" + std::to_string(index) + "]scale=" + width + ":" + height + "[out" + std::to_string(index) + "]";
+    }
 
-    std::string cmd = m_FFmpegPath + " ";
-    for (auto arg : args) {
-        cmd += arg + " ";
+    args.push_back("-filter_complex \"" + graph + "\"");
+
+    for (size_t index = 0; index < count; index++) {
+        const ofxFFmpegRendition &rendition = settings.renditions[index];
+        const std::string stream = std::to_string(index);
+        args.push_back("-map \"[out" + stream + "]\"");
+        args.push_back("-c:v:" + stream + " " + m_VideCodec);
+        if (rendition.preset.length() > 0) {
+            args.push_back("-preset:v:" + stream + " " + rendition.preset);
+        }
+
+        const std::string bitRate = std::to_string(rendition.bitRate);
+        args.push_back("-b:v:" + stream + " " + bitRate + "k");
+        args.push_back("-maxrate:v:" + stream + " " + bitRate + "k");
+        args.push_back("-bufsize:v:" + stream + " " + std::to_string(rendition.bitRate * 2) + "k");
     }
 
-    #if defined(_WIN32)
-    m_CustomRecordingFile = _popen(cmd.c_str(), "w");
-#else
-    m_CustomRecordingFile = popen(cmd.c_str(), "w");
-#endif
+    // Every segment of every rendition starts with a keyframe at the same time, so that a player can switch between them.
+    const std::string duration = std::to_string(settings.segmentDuration);
+    const int gopSize = std::max(static_cast<int>(std::round(settings.segmentDuration * m_Fps)), 1);
+    args.push_back("-r " + std::to_string(m_Fps));
+    args.push_back("-g " + std::to_string(gopSize));
+    args.push_back("-keyint_min " + std::to_string(gopSize));
+    args.push_back("-force_key_frames \"expr:gte(t,n_forced*" + duration + ")\"");
 
-    return true;
+    if (m_EncoderThreads > 0) {
+        args.push_back("-threads " + std::to_string(m_EncoderThreads));
+    }
 
-}
+    std::copy(m_AdditionalOutputArguments.begin(), m_AdditionalOutputArguments.end(), std::back_inserter(args));
 
-size_t ofxFFmpegRecorder::addFrame(const ofPixels &pixels)
-{
-    if (m_IsPaused) {
-        LOG_NOTICE("Recording is paused.");
-        return 0;
+    if (settings.format == OFX_FFMPEG_LADDER_DASH) {
+        args.push_back("-f dash");
+        args.push_back("-seg_duration " + duration);
+        args.push_back("-use_template 1");
+        args.push_back("-use_timeline 1");
+        args.push_back("-adaptation_sets \"id=0,streams=v\"");
+        if (settings.playlistSize > 0) {
+            args.push_back("-window_size " + std::to_string(settings.playlistSize));
+        }
+
+        args.push_back("\"" + getLadderPlaylistPath() + "\"");
+        return args;
     }
 
-    if (m_CustomRecordingFile == nullptr) {
-        LOG_ERROR("Custom recording is not in proggress. Cannot add the frame.");
-        return 0;
+    args.push_back("-f hls");
+    args.push_back("-hls_time " + duration);
+    if (settings.playlistSize > 0) {
+        args.push_back("-hls_list_size " + std::to_string(settings.playlistSize));
+        args.push_back("-hls_flags independent_segments+delete_segments");
+    }
+    else {
+        args.push_back("-hls_list_size 0");
+        args.push_back("-hls_playlist_type event");
+        args.push_back("-hls_flags independent_segments");
     }
 
-    if (pixels.isAllocated() == false) {
-        LOG_ERROR("Given pixels is not allocated.");
-        return 0;
+    std::string streamMap;
+    for (size_t index = 0; index < count; index++) {
+        streamMap += (index > 0 ? " v:" : "v:") + std::to_string(index);
+    }
+
+    args.push_back("-master_pl_name master.m3u8");
+    args.push_back("-var_stream_map \"" + streamMap + "\"");
+    args.push_back("-hls_segment_filename \"" + ofFilePath::join(settings.directory, "stream_%v/segment_%05d.ts") + "\"");
+    args.push_back("\"" + ofFilePath::join(settings.directory, "stream_%v/index.m3u8") + "\"");
+    return args;
+}
+
+bool ofxFFmpegRecorder::startCustomRecord(std::shared_ptr<ofxFFmpegFrameSink> sink)
+{
+    if (isRecording()) {
+        LOG_ERROR("A recording is already in proggress.");
+        return false;
+    }
+
+    if (sink == nullptr) {
+        LOG_ERROR("The sink is null. Cannot record.");
+        return false;
+    }
+
+    m_AddedVideoFrames = 0;
+    m_WrittenVideoFrames = 0;
+    resetStats();
+
+    m_FrameSink = sink;
+    m_IsCustomRecording = true;
+    return true;
+}
+
+void ofxFFmpegRecorder::addFrameSink(std::shared_ptr<ofxFFmpegFrameSink> sink)
+{
+    if (isRecording()) {
+        LOG_ERROR("A recording is in proggress. Cannot add the sink.");
+        return;
+    }
+
+    if (sink) {
+        m_FrameSinks.push_back(sink);
+    }
+}
+
+std::shared_ptr<ofxFFmpegWriterPool> ofxFFmpegRecorder::getWriterPool() const
+{
+    return m_WriterPool;
+}
+
+void ofxFFmpegRecorder::setWriterPool(std::shared_ptr<ofxFFmpegWriterPool> pool)
+{
+    if (isRecording()) {
+        LOG_NOTICE("A recording is in proggress. The change will take effect for the next recording session.");
+    }
+
+    m_WriterPool = pool;
+}
+
+void ofxFFmpegRecorder::clearFrameSinks()
+{
+    if (isRecording()) {
+        LOG_ERROR("A recording is in proggress. Cannot remove the sinks.");
+        return;
+    }
+
+    m_FrameSinks.clear();
+}
+
+bool ofxFFmpegRecorder::startCustomAudioRecord()
+{
+    if (isRecording()) {
+        LOG_ERROR("A recording is already in proggress.");
+        return false;
+    }
+
+    if (m_OutputPath.length() == 0) {
+        LOG_ERROR("Output path is empty. Cannot record.");
+        return false;
+    }
+
+    if (ofFile::doesFileExist(m_OutputPath, false) && m_IsOverWrite == false) {
+        LOG_ERROR("The output file already exists and overwriting is disabled. Cannot capture audio.");
+        return false;
+    }
+
+    m_AddedAudioFrames = 0;
+    resetStats();
+
+    std::vector<std::string> args;
+    std::copy(m_AdditionalInputArguments.begin(), m_AdditionalInputArguments.end(), std::back_inserter(args));
+
+    // audio input config
+    args.push_back("-y");
+    args.push_back("-vn");
+    args.push_back("-r " + std::to_string(m_sampleRate));
+    args.push_back("-f f32le");
+    //args.push_back("-acodec aac");
+    args.push_back("-ac 1");
+    args.push_back("-i -");
+
+
+    // audio export file config
+    args.push_back("-acodec " + m_AudioCodec);
+    args.push_back("-f mp3");
+    args.push_back("-ar " + std::to_string(m_sampleRate));
+    args.push_back("-ac 1");
+    args.push_back("-b:a 320k");
+    if (m_EncoderThreads > 0) {
+        args.push_back("-threads " + std::to_string(m_EncoderThreads));
+    }
+
+    std::copy(m_AdditionalOutputArguments.begin(), m_AdditionalOutputArguments.end(), std::back_inserter(args));
+
+    args.push_back(m_OutputPath);
+
+    std::string cmd = getEncoderCommandPrefix() + m_FFmpegPath + " ";
+    for (auto arg : args) {
+        cmd += arg + " ";
+    }
+
+#if defined(_WIN32)
+    m_CustomRecordingFile = _popen(cmd.c_str(), "wb");
+#else
+    m_CustomRecordingFile = ofxFFmpegOpenProcess(cmd, "w");
+#endif // _WIN32
+
+    m_IsCustomRecording = m_CustomRecordingFile != nullptr;
+    return true;
+}
+
+bool ofxFFmpegRecorder::startCustomStreaming()
+{
+    if (isRecording()) {
+        LOG_ERROR("A recording is already in proggress.");
+        return false;
+    }
+
+    if (m_LadderSettings.renditions.empty() == false) {
+        return startLadderRecord();
+    }
+
+    m_AddedVideoFrames = 0;
+    m_AddedAudioFrames = 0;
+    m_WrittenVideoFrames = 0;
+    resetStats();
+
+    std::vector<std::string> args;
+    std::copy(m_AdditionalInputArguments.begin(), m_AdditionalInputArguments.end(), std::back_inserter(args));
+    openProgressPipe(args);
+
+    args.push_back("-framerate " + std::to_string(m_Fps));
+    args.push_back("-s " + std::to_string(static_cast<unsigned int>(m_VideoSize.x)) + "x" + std::to_string(static_cast<unsigned int>(m_VideoSize.y)));
+    args.push_back("-f rawvideo");
+    args.push_back("-pix_fmt " + mPixFmt);
+    args.push_back("-vcodec rawvideo");
+    args.push_back("-i -");
+
+    const ofxFFmpegStreamSettings &settings = m_StreamSettings;
+    if (settings.videoCodec.length() > 0) {
+        args.push_back("-vcodec " + settings.videoCodec);
+    }
+
+    if (settings.preset.length() > 0) {
+        args.push_back("-preset " + settings.preset);
+    }
+
+    if (settings.zeroLatency) {
+        args.push_back("-tune zerolatency");
+    }
+
+    if (settings.gopSize >= 0) {
+        args.push_back("-g " + std::to_string(settings.gopSize));
+    }
+
+    if (settings.bFrames >= 0) {
+        args.push_back("-bf " + std::to_string(settings.bFrames));
+    }
+
+    args.push_back("-b:v " + std::to_string(m_BitRate) + "k");
+    if (m_EncoderThreads > 0) {
+        args.push_back("-threads " + std::to_string(m_EncoderThreads));
+    }
+
+    if (settings.flushPackets) {
+        // Write every packet as soon as it is muxed instead of buffering them in the muxer.
+        args.push_back("-flush_packets 1");
+        args.push_back("-max_delay 0");
+        if (settings.protocol == OFX_FFMPEG_STREAM_MPEGTS_UDP || settings.protocol == OFX_FFMPEG_STREAM_SRT) {
+            args.push_back("-muxdelay 0");
+            args.push_back("-muxpreload 0");
+        }
+    }
+
+    std::copy(m_AdditionalOutputArguments.begin(), m_AdditionalOutputArguments.end(), std::back_inserter(args));
+
+    switch (settings.protocol) {
+    case OFX_FFMPEG_STREAM_MPEGTS_UDP:
+    case OFX_FFMPEG_STREAM_SRT:
+        args.push_back("-f mpegts");
+        break;
+    case OFX_FFMPEG_STREAM_RTMP:
+        args.push_back("-f flv");
+        break;
+    default:
+        args.push_back("-f rtp");
+        break;
+    }
+
+    args.push_back("\"" + settings.url + "\"");
+
+    std::string cmd = getEncoderCommandPrefix() + m_FFmpegPath + " ";
+    for (auto arg : args) {
+        cmd += arg + " ";
+    }
+
+    #if defined(_WIN32)
+    m_CustomRecordingFile = _popen(cmd.c_str(), "w");
+#else
+    m_CustomRecordingFile = ofxFFmpegOpenProcess(cmd, "w", {m_ProgressPipe[1]});
+#endif
+
+    if (m_CustomRecordingFile) {
+        m_FrameSink = std::make_shared<ofxFFmpegPipeSink>(m_CustomRecordingFile);
+        m_IsCustomRecording = true;
+    }
+
+    startProgressReader();
+    return true;
+
+}
+
+size_t ofxFFmpegRecorder::addFrame(const ofPixels &pixels)
+{
+    return addFrameRegion(pixels, 0, 0, pixels.getWidth(), pixels.getHeight());
+}
+
+size_t ofxFFmpegRecorder::addFrame(const ofPixels &pixels, double pts)
+{
+    if (pts < 0) {
+        LOG_ERROR("The presentation time cannot be negative.");
+        return 0;
+    }
+
+    return addFrameRegion(pixels, 0, 0, pixels.getWidth(), pixels.getHeight(), pts);
+}
+
+std::shared_ptr<ofPixels> ofxFFmpegRecorder::acquireFrame()
+{
+    return m_FramePool->acquire();
+}
+
+size_t ofxFFmpegRecorder::addFrame(const std::shared_ptr<ofPixels> &frame)
+{
+    if (frame == nullptr) {
+        LOG_ERROR("Given frame is null.");
+        return 0;
+    }
+
+    return addFrameRegion(*frame, 0, 0, frame->getWidth(), frame->getHeight(), -1, frame);
+}
+
+size_t ofxFFmpegRecorder::addFrame(const ofPixels &pixels, const ofRectangle &roi)
+{
+    const ofRectangle region = roi.getStandardized();
+    const float x = std::round(region.x);
+    const float y = std::round(region.y);
+    const float width = std::round(region.width);
+    const float height = std::round(region.height);
+
+    if (x < 0 || y < 0 || width <= 0 || height <= 0 || x + width > pixels.getWidth() || y + height > pixels.getHeight()) {
+        LOG_ERROR("The region of interest is not inside the given pixels.");
+        return 0;
+    }
+
+    if (width != m_VideoSize.x || height != m_VideoSize.y) {
+        LOG_ERROR("The size of the region of interest must be the video size.");
+        return 0;
+    }
+
+    if (pixels.getTotalBytes() != pixels.getBytesStride() * pixels.getHeight()) {
+        LOG_ERROR("Only pixel formats with a single plane can be recorded from a region of interest.");
+        return 0;
+    }
+
+    return addFrameRegion(pixels, static_cast<size_t>(x), static_cast<size_t>(y), static_cast<size_t>(width), static_cast<size_t>(height));
+}
+
+size_t ofxFFmpegRecorder::addFrameRegion(const ofPixels &pixels, size_t x, size_t y, size_t width, size_t height, double pts,
+                                         const std::shared_ptr<ofPixels> &ownedFrame)
+{
+    if (m_IsPaused) {
+        LOG_NOTICE("Recording is paused.");
+        return 0;
+    }
+
+    if (isRecordingCustom() == false) {
+        LOG_ERROR("Custom recording is not in proggress. Cannot add the frame.");
+        return 0;
+    }
+
+    if (pixels.isAllocated() == false) {
+        LOG_ERROR("Given pixels is not allocated.");
+        return 0;
+    }
+
+    bool isMotionStart = false;
+    if (m_MotionThreshold > 0.f && updateMotionTrigger(pixels, x, y, width, height, pts, isMotionStart) == false) {
+        return 0;
+    }
+
+    size_t written = 0;
+
+    if (m_AddedVideoFrames == 0) {
+        startWriter();
+    }
+
+    // The real time that passed is scaled to the video time for the timelapse and the slow motion. In the offline mode the frames
+    // are counted instead.
+    const float timeScale = m_IsOffline ? 1.f : getTimeScale();
+    size_t frameCount = 0;
+    if (m_IsOffline && pts >= 0) {
+        const int64_t frameIndex = std::llround(pts * m_Fps) - m_MotionPtsOffset;
+        const int64_t addedFrames = m_AddedVideoFrames;
+        frameCount = frameIndex >= addedFrames ? static_cast<size_t>(frameIndex - addedFrames + 1) : 0;
+    }
+    else if (m_IsOffline) {
+        frameCount = 1;
+    }
+    else {
+        HighResClock now = std::chrono::high_resolution_clock::now();
+        const double recordedDuration = static_cast<double>(m_AddedVideoFrames) / m_Fps;
+        const double elapsed = std::chrono::duration<double>(now - m_RecordStartTime).count() - m_TotalPauseDuration;
+        double delta = elapsed * timeScale - recordedDuration;
+        const double framerate = 1.0 / m_Fps;
+        // The frame that starts the recording, or the motion, is always queued.
+        const bool isFirstFrame = m_AddedVideoFrames == 0 || isMotionStart;
+        while ((isFirstFrame && frameCount == 0) || delta >= framerate) {
+            delta -= framerate;
+            frameCount++;
+        }
+    }
+
+    // The frame is copied once, and the duplicates that are needed to keep up with the fps share the same copy.
+    const bool isWholeFrame = x == 0 && y == 0 && width == pixels.getWidth() && height == pixels.getHeight();
+    const size_t frameBytes = isWholeFrame ? pixels.getTotalBytes() : width * height * pixels.getBytesPerPixel();
+    std::shared_ptr<ofPixels> frame;
+    bool isSpilled = false;
+    for (size_t i = 0; i < frameCount; i++) {
+        if (m_IsOffline) {
+            if (m_IsInWriterPool && written > 0) {
+                m_SessionWriterPool->notify();
+            }
+
+            waitForQueueSpace();
+        }
+
+        bool isRepeat = true;
+        if (frame) {
+            m_Stats.duplicatedFrames++;
+        }
+        else if (m_IsSkippingStaticFrames && m_LastFrame
+                 && (isWholeFrame ? ofxFFmpegPixelsEqual(*m_LastFrame, pixels) : ofxFFmpegRegionEqual(*m_LastFrame, pixels, x, y))) {
+            // The frame did not change, so the last queued copy is used again.
+            frame = m_LastFrame;
+            m_Stats.staticFrames++;
+        }
+        else if (shouldSpillFrame(frameBytes) && m_SpillFile.push(pixels, x, y, width, height)) {
+            // The frame is filled from the spill file by the writer, the duplicates share it the same way.
+            frame = std::make_shared<ofPixels>();
+            isSpilled = true;
+            isRepeat = false;
+            m_Stats.spilledFrames++;
+        }
+        else {
+            isRepeat = false;
+            if (ownedFrame) {
+                // The caller filled a frame of the pool, so it is queued without a copy.
+                frame = ownedFrame;
+            }
+            else if (isWholeFrame) {
+                frame = m_FramePool->acquire();
+                *frame = pixels;
+            }
+            else {
+                frame = m_FramePool->acquire();
+                ofxFFmpegCopyRegion(pixels, x, y, width, height, *frame);
+            }
+
+            if (m_IsCompressingQueuedFrames && m_IsSkippingStaticFrames == false
+                && m_Stats.queuedFrames.load(std::memory_order_relaxed) >= m_CompressionThreshold) {
+                compressFrame(frame);
+            }
+        }
+
+        if (isRepeat && m_RecordCommand.isVariableFrameRate && m_UnwrittenFrames + 1 < m_Fps) {
+            // ffmpeg repeats the previous frame until the next one it reads. One repeat is written every second, so a static end of the
+            // recording is not lost if it is not stopped with stop().
+            m_UnwrittenFrames++;
+            m_Stats.unwrittenFrames++;
+        }
+        else {
+            m_UnwrittenFrames = 0;
+            addQueuedFrame(retainQueuedBuffer(*frame, frameBytes));
+            m_Frames.produce(frame);
+        }
+
+        m_AddedVideoFrames++;
+        written++;
+    }
+
+    if (written == 0) {
+        // When the video is sped up, most frames are skipped on purpose.
+        if (timeScale >= 1.f) {
+            m_Stats.droppedFrames++;
+        }
+    }
+    else if (m_IsInWriterPool) {
+        m_SessionWriterPool->notify();
+    }
+
+    if (frame && m_IsSkippingStaticFrames) {
+        // A spilled frame is filled by the writer thread, so it cannot be compared with the next frame.
+        if (isSpilled) {
+            m_LastFrame.reset();
+        }
+        else {
+            m_LastFrame = frame;
+        }
+    }
+
+    return written;
+}
+
+bool ofxFFmpegRecorder::updateMotionTrigger(const ofPixels &pixels, size_t x, size_t y, size_t width, size_t height, double pts,
+                                            bool &isMotionStart)
+{
+    // The time of the frame is its pts or its index in the offline mode, and the clock otherwise.
+    const bool hasPts = m_IsOffline && pts >= 0;
+    const float timeScale = m_IsOffline ? 1.f : getTimeScale();
+    const HighResClock now = std::chrono::high_resolution_clock::now();
+    double time = std::chrono::duration<double>(now.time_since_epoch()).count();
+    if (hasPts) {
+        time = pts;
+    }
+    else if (m_IsOffline) {
+        time = m_MotionFrameCount / m_Fps;
+    }
+
+    m_MotionFrameCount++;
+
+    m_MotionLevel = ofxFFmpegSampledDifference(pixels, x, y, width, height, m_MotionRowStep, m_MotionReference);
+    if (m_MotionLevel >= m_MotionThreshold) {
+        m_LastMotionTime = time;
+    }
+
+    const bool isWholeFrame = x == 0 && y == 0 && width == pixels.getWidth() && height == pixels.getHeight();
+    if (time - m_LastMotionTime > m_MotionPostRoll) {
+        m_IsMotionActive = false;
+        m_Stats.motionSkippedFrames++;
+
+        // At most one frame is kept for each frame of the video, the frames in between are not copied.
+        const double frameDuration = 1.0 / (m_Fps * timeScale);
+        if (m_MotionPreRoll > 0.f && (m_PreRollFrames.empty() || time - m_PreRollFrames.back().time >= frameDuration)) {
+            std::shared_ptr<ofPixels> frame = m_FramePool->acquire();
+            if (isWholeFrame) {
+                *frame = pixels;
+            }
+            else {
+                ofxFFmpegCopyRegion(pixels, x, y, width, height, *frame);
+            }
+
+            m_PreRollFrames.push_back({frame, time});
+            while (m_PreRollFrames.front().time < time - m_MotionPreRoll) {
+                m_PreRollFrames.pop_front();
+            }
+        }
+
+        return false;
+    }
+
+    if (m_IsMotionActive) {
+        return true;
+    }
+
+    m_IsMotionActive = true;
+    isMotionStart = true;
+    if (m_PreRollFrames.empty() == false) {
+        if (m_AddedVideoFrames == 0) {
+            startWriter();
+        }
+
+        // Each frame is repeated until the time of the next one, so the pre-roll keeps its duration.
+        const double start = m_PreRollFrames.front().time;
+        size_t queued = 0;
+        for (size_t index = 0; index < m_PreRollFrames.size(); index++) {
+            const std::shared_ptr<ofPixels> &frame = m_PreRollFrames[index].frame;
+            const double end = index + 1 < m_PreRollFrames.size() ? m_PreRollFrames[index + 1].time : time;
+            const size_t target = std::max<size_t>(static_cast<size_t>(std::llround((end - start) * m_Fps * timeScale)), queued + 1);
+            for (size_t repeat = 0; queued < target; repeat++, queued++) {
+                if (m_IsOffline) {
+                    if (m_IsInWriterPool) {
+                        m_SessionWriterPool->notify();
+                    }
+
+                    waitForQueueSpace();
+                }
+
+                if (repeat > 0) {
+                    m_Stats.duplicatedFrames++;
+                }
+
+                addQueuedFrame(retainQueuedBuffer(*frame, frame->getTotalBytes()));
+                m_Frames.produce(frame);
+                m_AddedVideoFrames++;
+            }
+        }
+
+        m_PreRollFrames.clear();
+        m_LastFrame.reset();
+        if (m_IsInWriterPool) {
+            m_SessionWriterPool->notify();
+        }
+    }
+
+    // The time without motion is left out of the video, so the pacing continues as if this frame was the next one.
+    if (hasPts) {
+        m_MotionPtsOffset = std::llround(pts * m_Fps) - static_cast<int64_t>(m_AddedVideoFrames);
+    }
+    else if (m_IsOffline == false && m_AddedVideoFrames > 0) {
+        const double elapsed = std::chrono::duration<double>(now - m_RecordStartTime).count();
+        m_TotalPauseDuration = elapsed - (static_cast<double>(m_AddedVideoFrames) + 1.0) / m_Fps / timeScale;
+    }
+
+    return true;
+}
+
+void ofxFFmpegRecorder::rebasePacing()
+{
+    if (isRecordingCustom() == false || m_IsOffline || m_AddedVideoFrames == 0) {
+        return;
+    }
+
+    // Without this the time that passed so far would be scaled again, which stalls the video or queues a burst of duplicates. While
+    // paused, the pause is added when it ends, so the pacing is moved to its start.
+    const HighResClock now = m_IsPaused ? m_PauseStartTime : std::chrono::high_resolution_clock::now();
+    const double elapsed = std::chrono::duration<double>(now - m_RecordStartTime).count();
+    m_TotalPauseDuration = elapsed - static_cast<double>(m_AddedVideoFrames) / m_Fps / getTimeScale();
+}
+
+void ofxFFmpegRecorder::resetMotionTrigger()
+{
+    m_MotionReference.clear();
+    m_PreRollFrames.clear();
+    m_MotionLevel = 0.f;
+    m_IsMotionActive = false;
+    m_LastMotionTime = -std::numeric_limits<double>::infinity();
+    m_MotionFrameCount = 0;
+}
+
+bool ofxFFmpegRecorder::submitFrame(uint64_t sequence, const ofPixels &pixels)
+{
+    if (m_IsPaused) {
+        LOG_NOTICE("Recording is paused.");
+        return false;
+    }
+
+    if (isRecordingCustom() == false) {
+        LOG_ERROR("Custom recording is not in proggress. Cannot add the frame.");
+        return false;
+    }
+
+    if (pixels.isAllocated() == false) {
+        LOG_ERROR("Given pixels is not allocated.");
+        return false;
+    }
+
+    // The copy is made on the calling thread, the lock only covers the reordering.
+    std::shared_ptr<ofPixels> frame = m_FramePool->acquire();
+    *frame = pixels;
+
+    std::unique_lock<std::mutex> lock(m_SubmitMutex);
+    if (m_IsOffline) {
+        // The next frame is always taken, so the waiting frames can be queued.
+        m_SubmitCondition.wait(lock, [this, sequence]() {
+            return sequence <= m_NextSequence || m_SubmittedFrames.size() < m_MaxReorderedFrames || m_IsCustomRecording == false;
+        });
+    }
+
+    // stopCustom() clears the frames and stops the recording under the lock, so a frame is never left for the next recording.
+    if (m_IsCustomRecording == false) {
+        LOG_ERROR("Custom recording is not in proggress. Cannot add the frame.");
+        return false;
+    }
+
+    if (sequence < m_NextSequence || m_SubmittedFrames.count(sequence) > 0) {
+        LOG_ERROR("The frame " + std::to_string(sequence) + " was already added or skipped.");
+        return false;
+    }
+
+    m_SubmittedFrames.emplace(sequence, std::move(frame));
+    if (m_IsOffline == false && m_SubmittedFrames.size() > m_MaxReorderedFrames) {
+        const uint64_t next = m_SubmittedFrames.begin()->first;
+        LOG_WARNING("The frames " + std::to_string(m_NextSequence) + " to " + std::to_string(next - 1)
+                    + " are missing. The frames after them are queued without them.");
+        m_Stats.droppedFrames += next - m_NextSequence;
+        m_NextSequence = next;
+    }
+
+    queueSubmittedFrames(false);
+    return true;
+}
+
+size_t ofxFFmpegRecorder::getMaxReorderedFrames() const
+{
+    return m_MaxReorderedFrames;
+}
+
+void ofxFFmpegRecorder::setMaxReorderedFrames(size_t frames)
+{
+    if (isRecording()) {
+        LOG_NOTICE("A recording is in proggress. The change will take effect for the next recording session.");
+    }
+
+    m_MaxReorderedFrames = std::max<size_t>(frames, 1);
+}
+
+size_t ofxFFmpegRecorder::encodeImageSequence(const std::string &source, size_t threadCount, size_t startNumber)
+{
+    if (isRecording()) {
+        LOG_ERROR("A recording is already in proggress.");
+        return 0;
+    }
+
+    const std::vector<std::string> paths = getImageSequencePaths(source, startNumber);
+    if (paths.empty()) {
+        LOG_ERROR("No images are found in " + source + ".");
+        return 0;
+    }
+
+    // The first image is loaded on this thread, which also initializes the image loader before the decoding threads use it.
+    std::shared_ptr<ofPixels> firstFrame = m_FramePool->acquire();
+    if (ofLoadImage(*firstFrame, paths.front()) == false) {
+        LOG_ERROR("Cannot load " + paths.front() + ".");
+        return 0;
+    }
+
+    if (m_VideoSize.x <= 0 || m_VideoSize.y <= 0) {
+        m_VideoSize = glm::vec2(firstFrame->getWidth(), firstFrame->getHeight());
+    }
+
+    const bool wasOffline = m_IsOffline;
+    m_IsOffline = true;
+    startCustomRecord();
+    if (isRecordingCustom() == false) {
+        m_IsOffline = wasOffline;
+        return 0;
+    }
+
+    if (threadCount == 0) {
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    // The threads take the images in order and do not run further ahead than the window, so the decoded frames that wait for an
+    // earlier one stay bounded.
+    const size_t window = threadCount * 2;
+    const size_t width = static_cast<size_t>(m_VideoSize.x);
+    const size_t height = static_cast<size_t>(m_VideoSize.y);
+    const ofImageType imageType = mPixFmt == "gray" ? OF_IMAGE_GRAYSCALE : OF_IMAGE_COLOR;
+
+    // Every frame that is decoded or queued goes back to the pool, so they are all reused instead of being reallocated.
+    const size_t maxFreeFrames = m_FramePool->getMaxFreeCount();
+    m_FramePool->setMaxFreeCount(std::max(maxFreeFrames, window + m_OfflineMaxQueuedFrames + 1));
+
+    auto convert = [&](ofPixels &frame) {
+        if (frame.getImageType() != imageType) {
+            frame.setImageType(imageType);
+        }
+
+        if (frame.getWidth() != width || frame.getHeight() != height) {
+            frame.resize(width, height, OF_INTERPOLATE_BILINEAR);
+        }
+    };
+
+    convert(*firstFrame);
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::map<size_t, std::shared_ptr<ofPixels>> decodedFrames;
+    decodedFrames[0] = firstFrame;
+    firstFrame.reset();
+    std::atomic<size_t> nextPath(1);
+    size_t nextFrame = 0;
+
+    auto decode = [&]() {
+        while (true) {
+            const size_t index = nextPath++;
+            if (index >= paths.size()) {
+                break;
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [&]() {
+                    return index < nextFrame + window;
+                });
+            }
+
+            std::shared_ptr<ofPixels> frame = m_FramePool->acquire();
+            if (ofLoadImage(*frame, paths[index])) {
+                convert(*frame);
+            }
+            else {
+                frame = nullptr;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            decodedFrames[index] = frame;
+            condition.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < std::min(threadCount, paths.size() - 1); i++) {
+        threads.emplace_back(decode);
+    }
+
+    size_t encoded = 0;
+    for (size_t index = 0; index < paths.size(); index++) {
+        std::shared_ptr<ofPixels> frame;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [&]() {
+                return decodedFrames.count(index) > 0;
+            });
+
+            frame = decodedFrames[index];
+            decodedFrames.erase(index);
+            nextFrame = index + 1;
+        }
+
+        condition.notify_all();
+        if (frame == nullptr) {
+            LOG_WARNING("Cannot load " + paths[index] + ". It is skipped.");
+            continue;
+        }
+
+        // The decoded frame is queued as is, without the copy of addFrame().
+        if (m_AddedVideoFrames == 0) {
+            startWriter();
+        }
+        else if (m_IsInWriterPool) {
+            m_SessionWriterPool->notify();
+        }
+
+        waitForQueueSpace();
+        addQueuedFrame(retainQueuedBuffer(*frame, frame->getTotalBytes()));
+        m_Frames.produce(frame);
+        m_AddedVideoFrames++;
+        encoded++;
+    }
+
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    stop();
+    m_IsOffline = wasOffline;
+    m_FramePool->setMaxFreeCount(maxFreeFrames);
+    return encoded;
+}
+
+std::vector<std::string> ofxFFmpegRecorder::getImageSequencePaths(const std::string &source, size_t startNumber) const
+{
+    std::vector<std::string> paths;
+    if (source.find('%') == std::string::npos) {
+        ofDirectory directory(source);
+        for (const char *extension : {"png", "jpg", "jpeg", "bmp", "tif", "tiff"}) {
+            directory.allowExt(extension);
+        }
+
+        directory.listDir();
+        directory.sort();
+        for (size_t i = 0; i < directory.size(); i++) {
+            paths.push_back(directory.getPath(i));
+        }
+
+        return paths;
+    }
+
+    // The pattern is used as the format string, so it must have a single integer conversion and nothing else that reads an argument.
+    size_t conversionCount = 0, width = 0;
+    for (size_t i = 0; i < source.size(); i++) {
+        if (source[i] != '%') {
+            continue;
+        }
+
+        if (i + 1 < source.size() && source[i + 1] == '%') {
+            i++;
+            continue;
+        }
+
+        size_t end = i + 1;
+        if (end < source.size() && source[end] == '0') {
+            end++;
+        }
+
+        const size_t widthStart = end;
+        while (end < source.size() && std::isdigit(static_cast<unsigned char>(source[end]))) {
+            end++;
+        }
+
+        if (end >= source.size() || source[end] != 'd' || end - widthStart > 3) {
+            conversionCount = 0;
+            break;
+        }
+
+        width = end > widthStart ? std::stoul(source.substr(widthStart, end - widthStart)) : 0;
+        conversionCount++;
+        i = end;
+    }
+
+    if (conversionCount != 1) {
+        LOG_ERROR("The pattern " + source + " must have exactly one %d or %0Nd conversion, use %% for a literal %.");
+        return paths;
+    }
+
+    auto getPath = [&source, width](size_t number) {
+        std::vector<char> path(source.size() + width + 32);
+        std::snprintf(path.data(), path.size(), source.c_str(), static_cast<int>(number));
+        return std::string(path.data());
+    };
+
+    // ffmpeg also tries 1 when a sequence does not start from 0.
+    if (startNumber == 0 && ofFile::doesFileExist(getPath(0), false) == false) {
+        startNumber = 1;
+    }
+
+    for (size_t number = startNumber; ofFile::doesFileExist(getPath(number), false); number++) {
+        paths.push_back(getPath(number));
+    }
+
+    return paths;
+}
+
+void ofxFFmpegRecorder::queueSubmittedFrames(bool force)
+{
+    bool isQueued = false;
+    auto it = m_SubmittedFrames.begin();
+    while (it != m_SubmittedFrames.end() && (it->first == m_NextSequence || force)) {
+        if (m_AddedVideoFrames == 0) {
+            startWriter();
+        }
+
+        // The frames are queued one at a time under the lock, so many producers cannot go over the size of the queue together.
+        if (m_IsOffline) {
+            if (m_IsInWriterPool && isQueued) {
+                m_SessionWriterPool->notify();
+            }
+
+            waitForQueueSpace();
+        }
+
+        std::shared_ptr<ofPixels> frame = std::move(it->second);
+        const size_t frameBytes = frame->getTotalBytes();
+        if (shouldSpillFrame(frameBytes) && m_SpillFile.push(*frame, 0, 0, frame->getWidth(), frame->getHeight())) {
+            // The frame is filled from the spill file by the writer, and the copy goes back to the pool.
+            frame = std::make_shared<ofPixels>();
+            m_Stats.spilledFrames++;
+        }
+        else if (m_IsCompressingQueuedFrames && m_Stats.queuedFrames.load(std::memory_order_relaxed) >= m_CompressionThreshold) {
+            compressFrame(frame);
+        }
+
+        addQueuedFrame(retainQueuedBuffer(*frame, frameBytes));
+        m_Frames.produce(frame);
+        m_AddedVideoFrames++;
+        m_NextSequence = it->first + 1;
+        it = m_SubmittedFrames.erase(it);
+        isQueued = true;
+    }
+
+    if (isQueued) {
+        m_SubmitCondition.notify_all();
+        if (m_IsInWriterPool) {
+            m_SessionWriterPool->notify();
+        }
+    }
+}
+
+void ofxFFmpegRecorder::startWriter()
+{
+    if (m_WriterPool) {
+        if (m_AdaptiveSettings.levels.size() > 1) {
+            LOG_WARNING("Adaptive encoding is not supported with a writer pool. The first level is used for the whole recording.");
+        }
+
+        // The pool is kept for the session, setWriterPool() only changes the pool of the next one.
+        m_SessionWriterPool = m_WriterPool;
+        m_IsInWriterPool = true;
+        m_SessionWriterPool->add(this, m_FrameSink->getFileDescriptor());
+    }
+    else {
+        m_Thread = std::thread(&ofxFFmpegRecorder::processFrame, this);
+    }
+
+    m_RecordStartTime = std::chrono::high_resolution_clock::now();
+    m_TotalPauseDuration = 0.0;
+}
+
+size_t ofxFFmpegRecorder::addBuffer(const ofSoundBuffer &buffer, float afps){
+    if (m_IsPaused) {
+        LOG_NOTICE("Recording is paused.");
+        return 0;
+    }
+
+    if (m_CustomRecordingFile == nullptr) {
+        LOG_ERROR("Custom recording is not in proggress. Cannot add the frame.");
+        return 0;
+    }
+
+    if (buffer.getBuffer().size() == 0 ) {
+        LOG_ERROR("Given buffer is not allocated.");
+        return 0;
     }
 
     size_t written = 0;
 
-    if (m_AddedVideoFrames == 0) {
-        m_Thread = std::thread(&ofxFFmpegRecorder::processFrame, this);
-        m_RecordStartTime = std::chrono::high_resolution_clock::now();
+    if (m_AddedAudioFrames == 0) {
+        m_Thread = std::thread(&ofxFFmpegRecorder::processBuffer, this);
+        m_RecordStartTime = std::chrono::high_resolution_clock::now();
+    }
+
+    HighResClock now = std::chrono::high_resolution_clock::now();
+    const float recordedDuration = getRecordedAudioDuration(afps);
+    float delta = std::chrono::duration<float>(now - m_RecordStartTime).count() - recordedDuration - m_TotalPauseDuration;
+    const float framerate = 1.f / m_Fps;
+
+    while (m_AddedAudioFrames == 0 || delta >= framerate) {
+        delta -= framerate;
+        addQueuedFrame(buffer.getBuffer().size() * sizeof(float));
+        m_Buffers.produce(new ofSoundBuffer(buffer));
+        m_AddedAudioFrames++;
+    }
+
+    return written;
+}
+
+void ofxFFmpegRecorder::stop()
+{
+    if (isRecordingCustom()) {
+        stopCustom(false);
+    }
+    else if (m_DefaultRecordingFile) {
+        fwrite("q", sizeof(char), 1, m_DefaultRecordingFile);
+        #if defined(_WIN32)
+        _pclose(m_DefaultRecordingFile);
+        #else
+        pclose(m_DefaultRecordingFile);
+        #endif
+        m_DefaultRecordingFile = nullptr;
+        joinPreviewReader();
+    }
+}
+
+void ofxFFmpegRecorder::cancel()
+{
+    if (isRecordingCustom()) {
+        stopCustom(true);
+    }
+    else if (m_DefaultRecordingFile) {
+        fwrite("q", sizeof(char), 1, m_DefaultRecordingFile);
+#if defined(_WIN32)
+        _pclose(m_DefaultRecordingFile);
+#else
+        pclose(m_DefaultRecordingFile);
+#endif
+        m_DefaultRecordingFile = nullptr;
+        joinPreviewReader();
+    }
+
+    ofFile::removeFile(m_OutputPath, false);
+
+    // The segments that the adaptive encoding started after the first one.
+    std::lock_guard<std::mutex> lock(m_SegmentMutex);
+    for (size_t i = 1; i < m_SegmentPaths.size(); i++) {
+        ofFile::removeFile(m_SegmentPaths[i], false);
+    }
+
+    m_SegmentPaths.clear();
+}
+
+bool ofxFFmpegRecorder::isOverWrite() const
+{
+    return m_IsOverWrite;
+}
+
+void ofxFFmpegRecorder::setOverWrite(bool overwrite)
+{
+    m_IsOverWrite = overwrite;
+}
+
+const std::vector<std::string> &ofxFFmpegRecorder::getAdditionalInputArguments() const
+{
+    return m_AdditionalInputArguments;
+}
+
+void ofxFFmpegRecorder::setAdditionalInputArguments(const std::vector<std::string> &args)
+{
+    if (isRecording()) {
+        LOG_NOTICE("A recording is in proggress. The change will take effect for the next recording session.");
+    }
+
+    m_AdditionalInputArguments = args;
+}
+
+void ofxFFmpegRecorder::addAdditionalInputArgument(const std::string &arg)
+{
+    if (isRecording()) {
+        LOG_NOTICE("A recording is in proggress. The change will take effect for the next recording session.");
+    }
+
+    m_AdditionalInputArguments.push_back(arg);
+}
+
+void ofxFFmpegRecorder::clearAdditionalInputArguments()
+{
+    m_AdditionalInputArguments.clear();
+}
+
+const std::vector<std::string> &ofxFFmpegRecorder::getAdditionalOutputArguments() const
+{
+    return m_AdditionalOutputArguments;
+}
+
+void ofxFFmpegRecorder::setAdditionalOutputArguments(const std::vector<std::string> &args)
+{
+    if (isRecording()) {
+        LOG_NOTICE("A recording is in proggress. The change will take effect for the next recording session.");
+    }
+
+    m_AdditionalOutputArguments = args;
+}
+
+void ofxFFmpegRecorder::addAdditionalOutputArgument(const std::string &arg)
+{
+    if (isRecording()) {
+        LOG_NOTICE("A recording is in proggress. The change will take effect for the next recording session.");
+    }
+
+    m_AdditionalOutputArguments.push_back(arg);
+}
+
+void ofxFFmpegRecorder::clearAdditionalOutputArguments()
+{
+    m_AdditionalOutputArguments.clear();
+}
+
+void ofxFFmpegRecorder::clearAdditionalArguments()
+{
+    m_AdditionalInputArguments.clear();
+    m_AdditionalOutputArguments.clear();
+}
+
+bool ofxFFmpegRecorder::isRecording() const
+{
+    return m_DefaultRecordingFile != nullptr || m_IsCustomRecording;
+}
+
+bool ofxFFmpegRecorder::isRecordingCustom() const
+{
+    return m_IsCustomRecording;
+}
+
+bool ofxFFmpegRecorder::isRecordingDefault() const
+{
+    return m_DefaultRecordingFile != nullptr;
+}
+
+
+void ofxFFmpegRecorder::saveThumbnail(const unsigned int &hour, const unsigned int &minute, const float &second, const std::string &output, glm::vec2 size,
+                                      ofRectangle crop, std::string videoFilePath)
+{
+    if (videoFilePath.length() == 0) {
+        if (isRecording()) {
+            LOG_ERROR("Cannot use the default video file because a recording is already in proggress.");
+            return;
+        }
+
+        videoFilePath = m_OutputPath;
+
+        if (ofFile::doesFileExist(m_OutputPath, false) == false) {
+            LOG_ERROR("The video file (" + videoFilePath + " does not exist!");
+            return;
+        }
+    }
+
+    const std::string time = std::to_string(hour) + ":" + std::to_string(minute) + ":" + std::to_string(second);
+    std::vector<std::string> args;
+
+    // -ss before -i seeks the input to the nearest keyframe instead of decoding everything up to the given time.
+    args.push_back("-ss " + time);
+    args.push_back("-i " + videoFilePath);
+    args.push_back("-vframes 1");
+
+    const std::string vfString = getThumbnailFilter(size, crop);
+    if (vfString.length() > 0) {
+        args.push_back("-vf " + vfString);
+    }
+
+    args.push_back(output);
+
+    std::string cmd = m_FFmpegPath + " ";
+    for (auto arg : args) {
+        cmd += arg + " ";
+    }
+    
+#if defined(_WIN32)
+    FILE *file = _popen(cmd.c_str(), "w");
+    _pclose(file);
+#else
+    FILE *file = ofxFFmpegOpenProcess(cmd, "w");
+    pclose(file);
+#endif
+    
+}
+
+void ofxFFmpegRecorder::saveThumbnails(const std::vector<float> &seconds, const std::string &outputPattern, glm::vec2 size, ofRectangle crop,
+                                       std::string videoFilePath, unsigned int maxProcesses)
+{
+    if (seconds.empty()) {
+        LOG_WARNING("No thumbnail times are given.");
+        return;
+    }
+
+    if (videoFilePath.length() == 0) {
+        if (isRecording()) {
+            LOG_ERROR("Cannot use the default video file because a recording is already in proggress.");
+            return;
+        }
+
+        videoFilePath = m_OutputPath;
+
+        if (ofFile::doesFileExist(m_OutputPath, false) == false) {
+            LOG_ERROR("The video file (" + videoFilePath + " does not exist!");
+            return;
+        }
+    }
+
+    const std::string vfString = getThumbnailFilter(size, crop);
+    const size_t processCount = std::max<size_t>(1, std::min<size_t>(maxProcesses, seconds.size()));
+    const size_t perProcess = (seconds.size() + processCount - 1) / processCount;
+
+    // Every time is opened as a separate input with its own -ss so that each one is seeked independently, and each input is mapped
+    // to its own single frame output. This way a single process extracts all of the thumbnails without decoding the whole video.
+    auto extract = [this, &seconds, &outputPattern, &vfString, &videoFilePath](size_t begin, size_t end) {
+        std::vector<std::string> args;
+        args.push_back("-y");
+        for (size_t i = begin; i < end; i++) {
+            args.push_back("-ss " + std::to_string(seconds[i]));
+            args.push_back("-i \"" + videoFilePath + "\"");
+        }
+
+        for (size_t i = begin; i < end; i++) {
+            args.push_back("-map " + std::to_string(i - begin) + ":v:0");
+            args.push_back("-vframes 1");
+            if (vfString.length() > 0) {
+                args.push_back("-vf " + vfString);
+            }
+
+            args.push_back("\"" + getThumbnailPath(outputPattern, i) + "\"");
+        }
+
+        std::string cmd = m_FFmpegPath + " ";
+        for (auto arg : args) {
+            cmd += arg + " ";
+        }
+
+#if defined(_WIN32)
+        FILE *file = _popen(cmd.c_str(), "w");
+        _pclose(file);
+#else
+        FILE *file = ofxFFmpegOpenProcess(cmd, "w");
+        pclose(file);
+#endif
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t begin = perProcess; begin < seconds.size(); begin += perProcess) {
+        threads.push_back(std::thread(extract, begin, std::min(begin + perProcess, seconds.size())));
+    }
+
+    extract(0, std::min(perProcess, seconds.size()));
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+}
+
+bool ofxFFmpegRecorder::saveLiveThumbnail(const std::string &output, float recordTime, ofImageQualityType quality)
+{
+    if (isRecordingCustom() == false || m_IsRecordVideo == false) {
+        LOG_ERROR("Custom video recording is not in proggress. Cannot save a live thumbnail.");
+        return false;
+    }
+
+    LiveThumbnail thumbnail;
+    thumbnail.frame = recordTime < 0.f ? m_AddedVideoFrames.load() : static_cast<unsigned int>(recordTime * m_Fps);
+    thumbnail.output = output;
+    thumbnail.quality = quality;
+
+    std::lock_guard<std::mutex> lock(m_LiveThumbnailMutex);
+    m_LiveThumbnails.push_back(thumbnail);
+    m_HasLiveThumbnails = true;
+    return true;
+}
+
+ofxFFmpegRecorderStats ofxFFmpegRecorder::getStats() const
+{
+    ofxFFmpegRecorderStats stats;
+    stats.queuedFrames = m_Stats.queuedFrames.load(std::memory_order_relaxed);
+    stats.maxQueuedFrames = m_Stats.maxQueuedFrames.load(std::memory_order_relaxed);
+    stats.queuedBytes = m_Stats.queuedBytes.load(std::memory_order_relaxed);
+    stats.maxQueuedBytes = m_Stats.maxQueuedBytes.load(std::memory_order_relaxed);
+    stats.addedFrames = m_Stats.addedFrames.load(std::memory_order_relaxed);
+    stats.duplicatedFrames = m_Stats.duplicatedFrames.load(std::memory_order_relaxed);
+    stats.droppedFrames = m_Stats.droppedFrames.load(std::memory_order_relaxed);
+    stats.staticFrames = m_Stats.staticFrames.load(std::memory_order_relaxed);
+    stats.unwrittenFrames = m_Stats.unwrittenFrames.load(std::memory_order_relaxed);
+    stats.motionSkippedFrames = m_Stats.motionSkippedFrames.load(std::memory_order_relaxed);
+    stats.compressedFrames = m_Stats.compressedFrames.load(std::memory_order_relaxed);
+    stats.compressionSavedBytes = m_Stats.compressionSavedBytes.load(std::memory_order_relaxed);
+    stats.spilledFrames = m_Stats.spilledFrames.load(std::memory_order_relaxed);
+    stats.queuedSpilledFrames = m_SpillFile.getCount();
+    stats.writtenFrames = m_Stats.writtenFrames.load(std::memory_order_relaxed);
+    stats.writtenBytes = m_Stats.writtenBytes.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < stats.writeLatencyHistogram.size(); i++) {
+        stats.writeLatencyHistogram[i] = m_Stats.writeLatencyHistogram[i].load(std::memory_order_relaxed);
+    }
+
+    stats.encodedFrames = m_Stats.encodedFrames.load(std::memory_order_relaxed);
+    stats.encoderFps = m_Stats.encoderFps.load(std::memory_order_relaxed);
+    stats.encoderSpeed = m_Stats.encoderSpeed.load(std::memory_order_relaxed);
+    stats.poolAllocatedFrames = m_FramePool->getAllocatedCount();
+    stats.poolFreeFrames = m_FramePool->getFreeCount();
+
+    if (isRecordingCustom() && stats.writtenBytes > 0) {
+        const float elapsed = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - m_RecordStartTime).count();
+        if (elapsed > 0.f) {
+            stats.pipeThroughput = stats.writtenBytes / elapsed;
+        }
+    }
+
+    return stats;
+}
+
+std::string ofxFFmpegRecorder::getThumbnailFilter(glm::vec2 size, const ofRectangle &crop) const
+{
+    std::string vfString = "\"";
+    if (size.x > 0 && size.y > 0) {
+        vfString += "scale=" + std::to_string(size.x) + ":" + std::to_string(size.y);
+    }
+
+    if (crop.isZero() == false) {
+        // Decide if a comma is required.
+        if (vfString.length() > 1) {
+            vfString += ",";
+        }
+
+        vfString += "crop=" + std::to_string(crop.getWidth()) + ":" + std::to_string(crop.getHeight());
+        if (crop.getX() > 0 && crop.getY() > 0) {
+            vfString += ":" + std::to_string(crop.getX()) + ":" + std::to_string(crop.getY());
+        }
+    }
+
+    if (vfString.length() == 1) {
+        return "";
+    }
+
+    return vfString + "\"";
+}
+
+std::string ofxFFmpegRecorder::getThumbnailPath(const std::string &outputPattern, size_t index) const
+{
+    const size_t pos = outputPattern.find("%d");
+    if (pos != std::string::npos) {
+        return outputPattern.substr(0, pos) + std::to_string(index) + outputPattern.substr(pos + 2);
+    }
+
+    const size_t extPos = outputPattern.find_last_of('.');
+    if (extPos == std::string::npos || outputPattern.find_first_of("/\\", extPos) != std::string::npos) {
+        return outputPattern + "_" + std::to_string(index);
     }
 
-    HighResClock now = std::chrono::high_resolution_clock::now();
-    const float recordedDuration = getRecordedDuration();
-    float delta = std::chrono::duration<float>(now - m_RecordStartTime).count() - recordedDuration - m_TotalPauseDuration;
-    const float framerate = 1.f / m_Fps;
+    return outputPattern.substr(0, extPos) + "_" + std::to_string(index) + outputPattern.substr(extPos);
+}
 
-    while (m_AddedVideoFrames == 0 || delta >= framerate) {
-        delta -= framerate;
-        m_Frames.produce(new ofPixels(pixels));
-        m_AddedVideoFrames++;
+void ofxFFmpegRecorder::determineDefaultDevices()
+{
+    if (m_IsRecordVideo && m_DefaultVideoDevice.deviceName.length() == 0) {
+        ofVideoGrabber videoGrabber;
+        const std::vector<ofVideoDevice> devices = videoGrabber.listDevices();
+
+        for (const ofVideoDevice &device : devices) {
+            if (device.bAvailable) {
+                m_DefaultVideoDevice = device;
+                break;
+            }
+        }
     }
 
-    return written;
+    if (m_IsRecordAudio && m_DefaultAudioDevice.isDefaultInput == false) {
+        ofSoundStream soundStream;
+        const std::vector<ofSoundDevice> audoDevices = soundStream.getDeviceList();
+
+        for (const ofSoundDevice &device : audoDevices) {
+            if (device.isDefaultInput) {
+                m_DefaultAudioDevice = device;
+                break;
+            }
+        }
+    }
 }
 
-size_t ofxFFmpegRecorder::addBuffer(const ofSoundBuffer &buffer, float afps){
-    if (m_IsPaused) {
-        LOG_NOTICE("Recording is paused.");
-        return 0;
+void ofxFFmpegRecorder::processFrame()
+{
+    applyWriterThreadSettings();
+
+    std::shared_ptr<ofPixels> pixels;
+    while (m_IsCustomRecording) {
+        if (m_Frames.consume(pixels) && pixels) {
+            writeFrame(pixels);
+            updateAdaptiveLevel();
+        }
+    }
+
+    // Write the frames that were added before the recording is stopped.
+    while (m_IsCancelled == false && m_Frames.consume(pixels)) {
+        if (pixels) {
+            writeFrame(pixels);
+        }
+    }
+}
+
+void ofxFFmpegRecorder::processBuffer()
+{
+    applyWriterThreadSettings();
+
+    ofSoundBuffer *buffer = nullptr;
+    while (m_IsCustomRecording) {
+        if (m_Buffers.consume(buffer) && buffer) {
+            writeBuffer(buffer);
+        }
+    }
+
+    while (m_IsCancelled == false && m_Buffers.consume(buffer)) {
+        if (buffer) {
+            writeBuffer(buffer);
+        }
+    }
+}
+
+void ofxFFmpegRecorder::writeFrame(const std::shared_ptr<ofPixels> &pixels)
+{
+    restoreFrame(*pixels);
+    const HighResClock writeStart = std::chrono::high_resolution_clock::now();
+    const size_t written = m_FrameSink->write(pixels);
+    finishFrame(pixels, written, writeStart);
+}
+
+void ofxFFmpegRecorder::finishFrame(const std::shared_ptr<ofPixels> &pixels, size_t written, const HighResClock &writeStart)
+{
+    if (written <= 0) {
+        LOG_WARNING("Cannot write the frame.");
     }
 
+    addWrite(written, writeStart);
+    for (const std::shared_ptr<ofxFFmpegFrameSink> &sink : m_FrameSinks) {
+        sink->write(pixels);
+    }
+
+    removeQueuedFrame(releaseQueuedBuffer(*pixels));
+    takeLiveThumbnails(pixels);
+    m_WrittenVideoFrames++;
+}
+
+void ofxFFmpegRecorder::updateAdaptiveLevel()
+{
+    const ofxFFmpegAdaptiveSettings &settings = m_RecordCommand.adaptiveSettings;
+    if (settings.levels.size() < 2 || m_CustomRecordingFile == nullptr || m_IsLadderRecording) {
+        return;
+    }
+
+    // The speed is 0 until ffmpeg reports it, then it is ignored.
+    const size_t queuedFrames = m_Stats.queuedFrames.load(std::memory_order_relaxed);
+    const float speed = m_Stats.encoderSpeed.load(std::memory_order_relaxed);
+    int load = 0;
+    if (queuedFrames > settings.maxQueuedFrames || (speed > 0.f && speed < settings.minSpeed)) {
+        load = 1;
+    }
+    else if (queuedFrames <= settings.minQueuedFrames && (speed <= 0.f || speed >= settings.recoverSpeed)) {
+        load = -1;
+    }
+
+    const HighResClock now = std::chrono::high_resolution_clock::now();
+    if (load != m_AdaptiveLoad) {
+        m_AdaptiveLoad = load;
+        m_AdaptiveLoadStart = now;
+    }
+
+    const float loadDuration = std::chrono::duration<float>(now - m_AdaptiveLoadStart).count();
+    const float levelDuration = std::chrono::duration<float>(now - m_AdaptiveLevelStart).count();
+    if (levelDuration < settings.minSegmentDuration) {
+        return;
+    }
+
+    size_t level = m_AdaptiveLevel;
+    if (load > 0 && loadDuration >= settings.stepDownDelay && level + 1 < settings.levels.size()) {
+        level++;
+    }
+    else if (load < 0 && loadDuration >= settings.stepUpDelay && level > 0) {
+        level--;
+    }
+    else {
+        return;
+    }
+
+    LOG_NOTICE("Switching to the adaptive encoding level " + std::to_string(level) + ". Queued frames: " + std::to_string(queuedFrames)
+               + ", speed: " + std::to_string(speed));
+
+    // A new ffmpeg process is started for the next segment while the current one is finished in the background, so the writer keeps
+    // draining the queue. The new segment starts with a keyframe.
+    closeSegment();
+    m_Stats.encoderSpeed = 0.f;
+    m_Stats.encoderFps = 0.f;
+
+    m_AdaptiveLevel = level;
+    m_AdaptiveLevelStart = now;
+    m_AdaptiveLoad = 0;
+    m_AdaptiveLoadStart = now;
+
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(m_SegmentMutex);
+        const std::string extension = ofFilePath::getFileExt(m_OutputPath);
+        path = ofFilePath::removeExt(m_OutputPath) + "_" + std::to_string(m_SegmentPaths.size()) + (extension.empty() ? "" : "." + extension);
+        m_SegmentPaths.push_back(path);
+    }
+
+    openCustomRecordPipe(path, level);
     if (m_CustomRecordingFile == nullptr) {
-        LOG_ERROR("Custom recording is not in proggress. Cannot add the frame.");
-        return 0;
+        LOG_ERROR("Cannot start ffmpeg for the segment " + path + ". The rest of the frames are discarded.");
+        m_FrameSink = std::make_shared<ofxFFmpegCallbackSink>(nullptr);
     }
+}
 
-    if (buffer.getBuffer().size() == 0 ) {
-        LOG_ERROR("Given buffer is not allocated.");
-        return 0;
+void ofxFFmpegRecorder::closeSegment()
+{
+    m_FrameSink->flush();
+    FILE *file = m_CustomRecordingFile;
+    m_CustomRecordingFile = nullptr;
+
+    // The readers of the segment stop when its ffmpeg process exits, so they are joined by the same thread.
+    std::thread progressReader = std::move(m_ProgressThread);
+    std::thread keyframeIndexReader = std::move(m_KeyframeIndexThread);
+    m_KeyframeIndex.reset();
+    m_SegmentClosers.push_back(std::thread([file, progress = std::move(progressReader), index = std::move(keyframeIndexReader)]() mutable {
+#if defined(_WIN32)
+        _pclose(file);
+#else
+        pclose(file);
+#endif
+        if (progress.joinable()) {
+            progress.join();
+        }
+
+        if (index.joinable()) {
+            index.join();
+        }
+    }));
+}
+
+void ofxFFmpegRecorder::joinSegmentClosers()
+{
+    for (std::thread &thread : m_SegmentClosers) {
+        thread.join();
     }
 
-    size_t written = 0;
+    m_SegmentClosers.clear();
+}
 
-    if (m_AddedAudioFrames == 0) {
-        m_Thread = std::thread(&ofxFFmpegRecorder::processBuffer, this);
-        m_RecordStartTime = std::chrono::high_resolution_clock::now();
+bool ofxFFmpegRecorder::hasPooledFrame() const
+{
+    // The frame that is being written is still counted as queued.
+    return m_Stats.queuedFrames.load(std::memory_order_relaxed) > 0;
+}
+
+bool ofxFFmpegRecorder::writePooledFrame(int fd)
+{
+    if (m_PooledFrame == nullptr) {
+        if (m_Frames.consume(m_PooledFrame) == false || m_PooledFrame == nullptr) {
+            return true;
+        }
+
+        restoreFrame(*m_PooledFrame);
+        m_PooledFrameOffset = 0;
+        m_PooledWriteStart = std::chrono::high_resolution_clock::now();
     }
 
-    HighResClock now = std::chrono::high_resolution_clock::now();
-    const float recordedDuration = getRecordedAudioDuration(afps);
-    float delta = std::chrono::duration<float>(now - m_RecordStartTime).count() - recordedDuration - m_TotalPauseDuration;
-    const float framerate = 1.f / m_Fps;
+    if (fd < 0) {
+        const size_t written = m_FrameSink->write(m_PooledFrame);
+        finishFrame(m_PooledFrame, written, m_PooledWriteStart);
+        m_PooledFrame.reset();
+        return true;
+    }
 
-    while (m_AddedAudioFrames == 0 || delta >= framerate) {
-        delta -= framerate;
-        m_Buffers.produce(new ofSoundBuffer(buffer));
-        m_AddedAudioFrames++;
+#if !defined(_WIN32)
+    const size_t dataLength = m_PooledFrame->getTotalBytes();
+    const ssize_t written = ::write(fd, m_PooledFrame->getData() + m_PooledFrameOffset, dataLength - m_PooledFrameOffset);
+    if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return false;
     }
 
-    return written;
+    if (written > 0) {
+        m_PooledFrameOffset += written;
+        if (m_PooledFrameOffset < dataLength) {
+            return true;
+        }
+    }
+
+    // The whole frame is written, or the pipe is broken.
+    finishFrame(m_PooledFrame, m_PooledFrameOffset, m_PooledWriteStart);
+    m_PooledFrame.reset();
+#endif
+
+    return true;
 }
 
-void ofxFFmpegRecorder::stop()
+void ofxFFmpegRecorder::leaveWriterPool(bool cancelled)
+{
+    m_SessionWriterPool->remove(this);
+    m_SessionWriterPool.reset();
+    m_IsInWriterPool = false;
+
+    if (cancelled == false) {
+        // The pipe is blocking again, finish the frame that was partially written and write the rest of the queue.
+        // A frame is only left partially written when the pool writes to the file descriptor without blocking.
+        const int fd = m_FrameSink->getFileDescriptor();
+        while (m_PooledFrame && writePooledFrame(fd)) {
+        }
+
+        std::shared_ptr<ofPixels> pixels;
+        while (m_Frames.consume(pixels)) {
+            if (pixels) {
+                writeFrame(pixels);
+            }
+        }
+    }
+    else if (m_PooledFrame) {
+        removeQueuedFrame(releaseQueuedBuffer(*m_PooledFrame));
+    }
+
+    m_PooledFrame.reset();
+}
+
+void ofxFFmpegRecorder::writeBuffer(ofSoundBuffer *buffer)
+{
+    //const float *data = buffer->getBuffer().data();
+    //const size_t dataLength = buffer->getBuffer().size();
+    const size_t dataLength = buffer->getBuffer().size();
+    const HighResClock writeStart = std::chrono::high_resolution_clock::now();
+    const size_t written = fwrite(&buffer->getBuffer()[0], sizeof(float), dataLength, m_CustomRecordingFile);
+    if (written <= 0) {
+        LOG_WARNING("Cannot write the buffer.");
+    }
+
+    addWrite(written * sizeof(float), writeStart);
+    removeQueuedFrame(dataLength * sizeof(float));
+    buffer->clear();
+    delete buffer;
+}
+
+void ofxFFmpegRecorder::stopCustom(bool cancelled)
 {
+    if (cancelled == false && m_UnwrittenFrames > 0 && m_LastFrame) {
+        // ffmpeg only knows how long the last frame lasts from the frame after it, so it is written again at the end.
+        addQueuedFrame(retainQueuedBuffer(*m_LastFrame, m_LastFrame->getTotalBytes()));
+        m_Frames.produce(m_LastFrame);
+    }
+
+    m_UnwrittenFrames = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_SubmitMutex);
+        if (cancelled == false && m_SubmittedFrames.empty() == false) {
+            LOG_WARNING("Some of the submitted frames are missing. The frames after them are written without them.");
+            queueSubmittedFrames(true);
+        }
+
+        m_SubmittedFrames.clear();
+        m_NextSequence = 0;
+
+        // This also wakes the producers of submitFrame() that wait for a missing frame in the offline mode.
+        m_IsCancelled = cancelled;
+        m_IsCustomRecording = false;
+        m_SubmitCondition.notify_all();
+    }
+
+    // The time that the motion trigger left out stays out of the recording when the trigger is disabled, so it is only reset here.
+    resetMotionTrigger();
+    m_MotionPtsOffset = 0;
+    joinThread();
+    m_IsCancelled = false;
+
+    if (m_IsInWriterPool) {
+        leaveWriterPool(cancelled);
+    }
+
+    // The writer pool and its final drain may still request live thumbnails, so they are joined after no frame can be written.
+    joinLiveThumbnails();
+
+    stopCompression();
+
+    // Discard what is left if the recording is cancelled, or if no frame was added so the writer thread was never started.
+    std::shared_ptr<ofPixels> pixels;
+    while (m_Frames.consume(pixels)) {
+        if (pixels) {
+            const size_t bytes = releaseQueuedBuffer(*pixels);
+            if (bytes > 0) {
+                discardFrame(*pixels);
+            }
+
+            removeQueuedFrame(bytes);
+        }
+    }
+
+    m_QueuedBuffers.clear();
+
+    m_CompressedFrames.clear();
+    m_SpillFile.close();
+    m_IsSpillFileFailed = false;
+    m_IsLadderRecording = false;
+
+    ofSoundBuffer *buffer = nullptr;
+    while (m_Buffers.consume(buffer)) {
+        if (buffer) {
+            removeQueuedFrame(buffer->getBuffer().size() * sizeof(float));
+            delete buffer;
+        }
+    }
+
+    if (m_FrameSink) {
+        m_FrameSink->flush();
+        m_FrameSink->close();
+        m_FrameSink.reset();
+    }
+
+    for (const std::shared_ptr<ofxFFmpegFrameSink> &sink : m_FrameSinks) {
+        sink->flush();
+        sink->close();
+    }
+
+    m_FrameSinks.clear();
+
     if (m_CustomRecordingFile) {
         #if defined(_WIN32)
         _pclose(m_CustomRecordingFile);
@@ -580,259 +2959,761 @@ void ofxFFmpegRecorder::stop()
         pclose(m_CustomRecordingFile);
         #endif
         m_CustomRecordingFile = nullptr;
-        m_AddedVideoFrames = 0;
-        m_AddedAudioFrames = 0;
-        joinThread();
     }
-    else if (m_DefaultRecordingFile) {
-        fwrite("q", sizeof(char), 1, m_DefaultRecordingFile);
-        #if defined(_WIN32)
-        _pclose(m_DefaultRecordingFile);
-        #else
-        pclose(m_DefaultRecordingFile);
-        #endif
-        m_DefaultRecordingFile = nullptr;
+
+    m_AddedVideoFrames = 0;
+    m_AddedAudioFrames = 0;
+    m_LastFrame.reset();
+    joinProgressReader();
+    joinKeyframeIndexReader();
+    joinSegmentClosers();
+
+    // The other kinds of recordings do not set the command, so the mode of this one must not carry over to them.
+    m_RecordCommand = CustomRecordCommand();
+}
+
+void ofxFFmpegRecorder::compressFrame(const std::shared_ptr<ofPixels> &frame)
+{
+    const size_t bytesPerPixel = frame->getBytesPerPixel();
+    if ((bytesPerPixel != 3 && bytesPerPixel != 4) || frame->getNumChannels() != bytesPerPixel) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_CompressionMutex);
+    // The state is added before the frame is queued, so the writer always finds it.
+    m_CompressedFrames[frame.get()] = CompressedFrame();
+    m_CompressionJobs.push_back(frame);
+    if (m_IsCompressionRunning == false) {
+        if (m_CompressionThread.joinable()) {
+            m_CompressionThread.join();
+        }
+
+        m_IsCompressionRunning = true;
+        m_CompressionThread = std::thread(&ofxFFmpegRecorder::processCompression, this);
+    }
+
+    m_CompressionCondition.notify_one();
+}
+
+void ofxFFmpegRecorder::processCompression()
+{
+    std::vector<unsigned char> data;
+    std::unique_lock<std::mutex> lock(m_CompressionMutex);
+    while (true) {
+        m_CompressionCondition.wait(lock, [this]() {
+            return m_CompressionJobs.empty() == false || m_IsCompressionRunning == false;
+        });
+
+        if (m_IsCompressionRunning == false) {
+            break;
+        }
+
+        std::shared_ptr<ofPixels> frame = std::move(m_CompressionJobs.front());
+        m_CompressionJobs.pop_front();
+
+        auto it = m_CompressedFrames.find(frame.get());
+        if (it == m_CompressedFrames.end()) {
+            continue;
+        }
+
+        if (it->second.state == CompressedFrame::Claimed) {
+            m_CompressedFrames.erase(it);
+            continue;
+        }
+
+        // The writer may read the frame while it is compressed, but it is only cleared if the writer has not claimed it.
+        it->second.state = CompressedFrame::Compressing;
+        lock.unlock();
+        const bool isCompressed = ofxFFmpegCompressPixels(*frame, data);
+        lock.lock();
+
+        it = m_CompressedFrames.find(frame.get());
+        if (it == m_CompressedFrames.end()) {
+            continue;
+        }
+
+        if (isCompressed == false || it->second.state == CompressedFrame::Claimed) {
+            m_CompressedFrames.erase(it);
+            continue;
+        }
+
+        CompressedFrame &compressed = it->second;
+        compressed.state = CompressedFrame::Compressed;
+        compressed.width = frame->getWidth();
+        compressed.height = frame->getHeight();
+        compressed.format = frame->getPixelFormat();
+        compressed.data.assign(data.begin(), data.end());
+        m_Stats.compressedFrames.fetch_add(1, std::memory_order_relaxed);
+        m_Stats.compressionSavedBytes.fetch_add(frame->getTotalBytes() - data.size(), std::memory_order_relaxed);
+        frame->clear();
+    }
+}
+
+void ofxFFmpegRecorder::stopCompression()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_CompressionMutex);
+        m_IsCompressionRunning = false;
+        m_CompressionJobs.clear();
+    }
+
+    m_CompressionCondition.notify_one();
+    if (m_CompressionThread.joinable()) {
+        m_CompressionThread.join();
+    }
+}
+
+void ofxFFmpegRecorder::restoreFrame(ofPixels &pixels)
+{
+    CompressedFrame compressed;
+    {
+        std::lock_guard<std::mutex> lock(m_CompressionMutex);
+        auto it = m_CompressedFrames.find(&pixels);
+        if (it != m_CompressedFrames.end()) {
+            if (it->second.state != CompressedFrame::Compressed) {
+                // The compression thread removes the frame when it sees that it is claimed.
+                it->second.state = CompressedFrame::Claimed;
+                return;
+            }
+
+            compressed = std::move(it->second);
+            m_CompressedFrames.erase(it);
+        }
+    }
+
+    if (compressed.state == CompressedFrame::Compressed) {
+        pixels.allocate(compressed.width, compressed.height, compressed.format);
+        ofxFFmpegDecompressPixels(compressed.data, pixels);
+    }
+    else if (pixels.isAllocated() == false && m_SpillFile.pop(pixels) == false) {
+        LOG_ERROR("The spilled frame cannot be read.");
+    }
+}
+
+void ofxFFmpegRecorder::discardFrame(const ofPixels &pixels)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_CompressionMutex);
+        auto it = m_CompressedFrames.find(&pixels);
+        if (it != m_CompressedFrames.end() && it->second.state == CompressedFrame::Compressed) {
+            m_CompressedFrames.erase(it);
+            return;
+        }
+    }
+
+    if (pixels.isAllocated() == false) {
+        m_SpillFile.discard();
+    }
+}
+
+bool ofxFFmpegRecorder::shouldSpillFrame(size_t bytes)
+{
+    if (m_QueueMemoryBudget == 0 || m_IsSpillFileFailed) {
+        return false;
+    }
+
+    const size_t memoryBytes = m_Stats.queuedBytes.load(std::memory_order_relaxed) - m_SpillFile.getBytes();
+    if (memoryBytes + bytes <= m_QueueMemoryBudget) {
+        return false;
+    }
+
+    if (m_SpillFile.isOpen() == false) {
+        std::string path = m_SpillPath;
+        if (path.empty()) {
+            const bool isFile = m_OutputPath.empty() == false && m_OutputPath != "-" && m_OutputPath.find("://") == std::string::npos;
+            path = isFile ? m_OutputPath + ".spill" : ofToDataPath("ofxFFmpegRecorder.spill", true);
+        }
+
+        if (m_SpillFile.open(path, m_SpillFileSize) == false) {
+            // The frames are kept in memory for the rest of the recording instead of trying again for every frame.
+            m_IsSpillFileFailed = true;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void ofxFFmpegRecorder::takeLiveThumbnails(const std::shared_ptr<ofPixels> &pixels)
+{
+    if (m_HasLiveThumbnails == false) {
+        return;
+    }
+
+    std::vector<LiveThumbnail> thumbnails;
+    {
+        std::lock_guard<std::mutex> lock(m_LiveThumbnailMutex);
+        auto it = std::partition(m_LiveThumbnails.begin(), m_LiveThumbnails.end(), [this](const LiveThumbnail &thumbnail) {
+            return thumbnail.frame > m_WrittenVideoFrames;
+        });
+
+        thumbnails.assign(it, m_LiveThumbnails.end());
+        m_LiveThumbnails.erase(it, m_LiveThumbnails.end());
+        m_HasLiveThumbnails = m_LiveThumbnails.empty() == false;
     }
-}
 
-void ofxFFmpegRecorder::cancel()
-{
-    if (m_CustomRecordingFile) {
-        #if defined(_WIN32)
-        _pclose(m_CustomRecordingFile);
-        #else
-        pclose(m_CustomRecordingFile);
-        #endif
-        m_CustomRecordingFile = nullptr;
-        m_AddedVideoFrames = 0;
-        m_AddedAudioFrames = 0;
-        joinThread();
+    if (thumbnails.empty()) {
+        return;
     }
-    else if (m_DefaultRecordingFile) {
-        fwrite("q", sizeof(char), 1, m_DefaultRecordingFile);
-#if defined(_WIN32)
-        _pclose(m_DefaultRecordingFile);
-#else
-        pclose(m_DefaultRecordingFile);
-#endif
-        m_DefaultRecordingFile = nullptr;
+
+    // The frame is already written to ffmpeg, so instead of copying it the encoding thread keeps a reference to the pixels.
+    std::lock_guard<std::mutex> lock(m_LiveThumbnailMutex);
+    m_LiveThumbnailJobs.push_back({pixels, std::move(thumbnails)});
+    if (m_IsLiveThumbnailRunning == false) {
+        if (m_LiveThumbnailThread.joinable()) {
+            m_LiveThumbnailThread.join();
+        }
+
+        m_IsLiveThumbnailRunning = true;
+        m_LiveThumbnailThread = std::thread(&ofxFFmpegRecorder::processLiveThumbnails, this);
     }
 
-    ofFile::removeFile(m_OutputPath, false);
+    m_LiveThumbnailCondition.notify_one();
 }
 
-bool ofxFFmpegRecorder::isOverWrite() const
+void ofxFFmpegRecorder::processLiveThumbnails()
 {
-    return m_IsOverWrite;
+    std::unique_lock<std::mutex> lock(m_LiveThumbnailMutex);
+    while (true) {
+        m_LiveThumbnailCondition.wait(lock, [this]() {
+            return m_LiveThumbnailJobs.empty() == false || m_IsLiveThumbnailRunning == false;
+        });
+
+        // The thumbnails that are already taken are written before the thread exits.
+        if (m_LiveThumbnailJobs.empty()) {
+            break;
+        }
+
+        LiveThumbnailJob job = std::move(m_LiveThumbnailJobs.front());
+        m_LiveThumbnailJobs.pop_front();
+
+        lock.unlock();
+        for (const LiveThumbnail &thumbnail : job.thumbnails) {
+            if (ofSaveImage(*job.pixels, thumbnail.output, thumbnail.quality) == false) {
+                LOG_ERROR("Cannot save the live thumbnail to " + thumbnail.output);
+            }
+        }
+
+        lock.lock();
+    }
 }
 
-void ofxFFmpegRecorder::setOverWrite(bool overwrite)
+void ofxFFmpegRecorder::resetStats()
 {
-    m_IsOverWrite = overwrite;
+    m_Stats.queuedFrames = 0;
+    m_Stats.maxQueuedFrames = 0;
+    m_Stats.queuedBytes = 0;
+    m_Stats.maxQueuedBytes = 0;
+    m_Stats.addedFrames = 0;
+    m_Stats.duplicatedFrames = 0;
+    m_Stats.droppedFrames = 0;
+    m_Stats.staticFrames = 0;
+    m_Stats.unwrittenFrames = 0;
+    m_Stats.motionSkippedFrames = 0;
+    m_Stats.compressedFrames = 0;
+    m_Stats.compressionSavedBytes = 0;
+    m_Stats.spilledFrames = 0;
+    m_Stats.writtenFrames = 0;
+    m_Stats.writtenBytes = 0;
+    for (std::atomic<uint64_t> &bucket : m_Stats.writeLatencyHistogram) {
+        bucket = 0;
+    }
+
+    m_Stats.encodedFrames = 0;
+    m_Stats.encoderFps = 0.f;
+    m_Stats.encoderSpeed = 0.f;
 }
 
-const std::vector<std::string> &ofxFFmpegRecorder::getAdditionalInputArguments() const
+void ofxFFmpegRecorder::addQueuedFrame(size_t bytes)
 {
-    return m_AdditionalInputArguments;
+    m_Stats.addedFrames.fetch_add(1, std::memory_order_relaxed);
+
+    // Only the producer increases the queue sizes, so the maximums cannot be raised concurrently.
+    const size_t frames = m_Stats.queuedFrames.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (frames > m_Stats.maxQueuedFrames.load(std::memory_order_relaxed)) {
+        m_Stats.maxQueuedFrames.store(frames, std::memory_order_relaxed);
+    }
+
+    const size_t queuedBytes = m_Stats.queuedBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    if (queuedBytes > m_Stats.maxQueuedBytes.load(std::memory_order_relaxed)) {
+        m_Stats.maxQueuedBytes.store(queuedBytes, std::memory_order_relaxed);
+    }
 }
 
-void ofxFFmpegRecorder::setAdditionalInputArguments(const std::vector<std::string> &args)
+void ofxFFmpegRecorder::removeQueuedFrame(size_t bytes)
 {
-    if (isRecording()) {
-        LOG_NOTICE("A recording is in proggress. The change will take effect for the next recording session.");
-    }
+    m_Stats.queuedFrames.fetch_sub(1, std::memory_order_relaxed);
+    m_Stats.queuedBytes.fetch_sub(bytes, std::memory_order_relaxed);
 
-    m_AdditionalInputArguments = args;
+    if (m_IsOffline) {
+        // Taking the lock makes sure that the producer is either waiting or has not checked the queue yet.
+        { std::lock_guard<std::mutex> lock(m_QueueSpaceMutex); }
+        m_QueueSpaceCondition.notify_one();
+    }
 }
 
-void ofxFFmpegRecorder::addAdditionalInputArgument(const std::string &arg)
+size_t ofxFFmpegRecorder::retainQueuedBuffer(const ofPixels &pixels, size_t bytes)
 {
-    if (isRecording()) {
-        LOG_NOTICE("A recording is in proggress. The change will take effect for the next recording session.");
+    std::lock_guard<std::mutex> lock(m_QueuedBuffersMutex);
+    QueuedBuffer &buffer = m_QueuedBuffers[&pixels];
+    if (buffer.count++ > 0) {
+        return 0;
     }
 
-    m_AdditionalInputArguments.push_back(arg);
+    buffer.bytes = bytes;
+    return bytes;
 }
 
-void ofxFFmpegRecorder::clearAdditionalInputArguments()
+size_t ofxFFmpegRecorder::releaseQueuedBuffer(const ofPixels &pixels)
 {
-    m_AdditionalInputArguments.clear();
+    std::lock_guard<std::mutex> lock(m_QueuedBuffersMutex);
+    auto it = m_QueuedBuffers.find(&pixels);
+    if (it == m_QueuedBuffers.end() || --it->second.count > 0) {
+        return 0;
+    }
+
+    const size_t bytes = it->second.bytes;
+    m_QueuedBuffers.erase(it);
+    return bytes;
 }
 
-const std::vector<std::string> &ofxFFmpegRecorder::getAdditionalOutputArguments() const
+void ofxFFmpegRecorder::waitForQueueSpace()
 {
-    return m_AdditionalOutputArguments;
+    std::unique_lock<std::mutex> lock(m_QueueSpaceMutex);
+    m_QueueSpaceCondition.wait(lock, [this]() {
+        return m_Stats.queuedFrames.load(std::memory_order_relaxed) < m_OfflineMaxQueuedFrames || m_IsCustomRecording == false;
+    });
 }
 
-void ofxFFmpegRecorder::setAdditionalOutputArguments(const std::vector<std::string> &args)
+void ofxFFmpegRecorder::addWrite(size_t bytes, const HighResClock &start)
 {
-    if (isRecording()) {
-        LOG_NOTICE("A recording is in proggress. The change will take effect for the next recording session.");
+    const auto micros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+    size_t bucket = 0;
+    while (bucket + 1 < ofxFFmpegRecorderStats::WriteLatencyBucketCount && (micros >> (bucket + 1)) > 0) {
+        bucket++;
     }
 
-    m_AdditionalOutputArguments = args;
+    m_Stats.writeLatencyHistogram[bucket].fetch_add(1, std::memory_order_relaxed);
+    m_Stats.writtenFrames.fetch_add(1, std::memory_order_relaxed);
+    m_Stats.writtenBytes.fetch_add(bytes, std::memory_order_relaxed);
 }
 
-void ofxFFmpegRecorder::addAdditionalOutputArgument(const std::string &arg)
+void ofxFFmpegRecorder::openProgressPipe(std::vector<std::string> &args)
 {
-    if (isRecording()) {
-        LOG_NOTICE("A recording is in proggress. The change will take effect for the next recording session.");
+#if defined(_WIN32)
+    // ffmpeg cannot inherit the pipe from _popen(), so the encoder stats are not available on Windows.
+#else
+    if (ofxFFmpegCreatePipe(m_ProgressPipe) == false) {
+        LOG_WARNING("Cannot create the progress pipe. The encoder stats will not be available.");
+        m_ProgressPipe[0] = -1;
+        m_ProgressPipe[1] = -1;
+        return;
     }
 
-    m_AdditionalOutputArguments.push_back(arg);
+    args.push_back("-progress pipe:" + std::to_string(m_ProgressPipe[1]));
+#endif
 }
 
-void ofxFFmpegRecorder::clearAdditionalOutputArguments()
+void ofxFFmpegRecorder::startProgressReader()
 {
-    m_AdditionalOutputArguments.clear();
+#if !defined(_WIN32)
+    if (m_ProgressPipe[1] < 0) {
+        return;
+    }
+
+    if (m_CustomRecordingFile == nullptr) {
+        LOG_ERROR("Cannot start ffmpeg.");
+        joinProgressReader();
+        return;
+    }
+
+    // Close our copy of the write end so the reader gets EOF when ffmpeg exits. The read end is owned by the reader.
+    close(m_ProgressPipe[1]);
+    m_ProgressPipe[1] = -1;
+    m_ProgressThread = std::thread(&ofxFFmpegRecorder::processProgress, this, m_ProgressPipe[0], ++m_ProgressGeneration);
+    m_ProgressPipe[0] = -1;
+#endif
 }
 
-void ofxFFmpegRecorder::clearAdditionalArguments()
+void ofxFFmpegRecorder::processProgress(int fd, uint64_t generation)
 {
-    m_AdditionalInputArguments.clear();
-    m_AdditionalOutputArguments.clear();
+#if !defined(_WIN32)
+    FILE *file = fdopen(fd, "r");
+    if (file == nullptr) {
+        close(fd);
+        return;
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        const std::string entry(line);
+        const size_t separator = entry.find('=');
+        if (separator == std::string::npos) {
+            continue;
+        }
+
+        // A segment that is finished in the background keeps reporting, but the stats are of the current segment.
+        if (m_ProgressGeneration != generation) {
+            continue;
+        }
+
+        const std::string key = entry.substr(0, separator);
+        const char *value = line + separator + 1;
+        if (key == "frame") {
+            m_Stats.encodedFrames.store(std::strtoull(value, nullptr, 10), std::memory_order_relaxed);
+        }
+        else if (key == "fps") {
+            m_Stats.encoderFps.store(std::strtof(value, nullptr), std::memory_order_relaxed);
+        }
+        else if (key == "speed") {
+            // The speed is reported as "1.02x", or "N/A" before the first frame is encoded.
+            m_Stats.encoderSpeed.store(std::strtof(value, nullptr), std::memory_order_relaxed);
+        }
+    }
+
+    fclose(file);
+#else
+    (void)fd;
+    (void)generation;
+#endif
 }
 
-bool ofxFFmpegRecorder::isRecording() const
+void ofxFFmpegRecorder::joinProgressReader()
 {
-    return m_DefaultRecordingFile != nullptr || m_CustomRecordingFile != nullptr;
+    if (m_ProgressThread.joinable()) {
+        m_ProgressThread.join();
+    }
+
+#if !defined(_WIN32)
+    // If ffmpeg could not be started, the pipe is never read.
+    for (int &fd : m_ProgressPipe) {
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+#endif
 }
 
-bool ofxFFmpegRecorder::isRecordingCustom() const
+bool ofxFFmpegRecorder::openKeyframeIndexPipe(const std::string &outputPath)
 {
-    return m_CustomRecordingFile != nullptr;
+    if (m_RecordCommand.isWritingKeyframeIndex == false) {
+        return false;
+    }
+
+#if defined(_WIN32)
+    LOG_WARNING("The keyframe index is not supported on Windows.");
+    return false;
+#else
+    if (ofxFFmpegCreatePipe(m_KeyframeIndexPipe) == false) {
+        LOG_WARNING("Cannot create the keyframe index pipe. The keyframe index will not be written.");
+        m_KeyframeIndexPipe[0] = -1;
+        m_KeyframeIndexPipe[1] = -1;
+        return false;
+    }
+
+    m_KeyframeIndex = std::make_shared<ofxFFmpegKeyframeIndex>();
+    if (m_KeyframeIndex->open(ofxFFmpegKeyframeIndex::getPath(outputPath), m_RecordCommand.fps) == false) {
+        joinKeyframeIndexReader();
+        return false;
+    }
+
+    return true;
+#endif
 }
 
-bool ofxFFmpegRecorder::isRecordingDefault() const
+void ofxFFmpegRecorder::startKeyframeIndexReader()
 {
-    return m_DefaultRecordingFile != nullptr;
-}
+#if !defined(_WIN32)
+    if (m_KeyframeIndexPipe[1] < 0) {
+        return;
+    }
+
+    if (m_CustomRecordingFile == nullptr) {
+        joinKeyframeIndexReader();
+        return;
+    }
 
+    // Close our copy of the write end so the reader gets EOF when ffmpeg exits. The read end is owned by the reader.
+    close(m_KeyframeIndexPipe[1]);
+    m_KeyframeIndexPipe[1] = -1;
+    m_KeyframeIndexThread = std::thread(&ofxFFmpegRecorder::processKeyframeIndex, this, m_KeyframeIndexPipe[0], m_KeyframeIndex,
+                                        m_RecordCommand.fps);
+    m_KeyframeIndexPipe[0] = -1;
+#endif
+}
 
-void ofxFFmpegRecorder::saveThumbnail(const unsigned int &hour, const unsigned int &minute, const float &second, const std::string &output, glm::vec2 size,
-                                      ofRectangle crop, std::string videoFilePath)
+void ofxFFmpegRecorder::processKeyframeIndex(int fd, std::shared_ptr<ofxFFmpegKeyframeIndex> index, float fps)
 {
-    if (videoFilePath.length() == 0) {
-        if (isRecording()) {
-            LOG_ERROR("Cannot use the default video file because a recording is already in proggress.");
-            return;
+#if !defined(_WIN32)
+    FILE *file = fdopen(fd, "r");
+    if (file == nullptr) {
+        close(fd);
+        index->close();
+        return;
+    }
+
+    // framecrc writes the time base as "#tb 0: 1/30", and then a line for each packet:
+    // "0,          0,          0,        1,    34567, 0x1a2b3c4d" where a packet that is not a keyframe ends with ", F=0x0".
+    double timeBase = 0.0;
+    uint64_t offset = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), file)) {
+        if (line[0] == '#') {
+            unsigned int numerator = 0, denominator = 0;
+            if (std::sscanf(line, "#tb 0: %u/%u", &numerator, &denominator) == 2 && denominator > 0) {
+                timeBase = static_cast<double>(numerator) / denominator;
+            }
+
+            continue;
         }
 
-        videoFilePath = m_OutputPath;
+        const std::vector<std::string> fields = ofSplitString(line, ",", true, true);
+        if (fields.size() < 6 || fields[0] != "0" || timeBase <= 0.0) {
+            continue;
+        }
 
-        if (ofFile::doesFileExist(m_OutputPath, false) == false) {
-            LOG_ERROR("The video file (" + videoFilePath + " does not exist!");
-            return;
+        const double time = std::strtoll(fields[2].c_str(), nullptr, 10) * timeBase;
+        const uint64_t size = std::strtoull(fields[4].c_str(), nullptr, 10);
+
+        ofxFFmpegKeyframeIndexEntry entry;
+        entry.pts = static_cast<int64_t>(std::llround(time * 1000000.0));
+        entry.offset = offset;
+        entry.frame = static_cast<uint32_t>(std::max<long long>(std::llround(time * fps), 0));
+        entry.flags = ofxFFmpegKeyframeIndexEntry::KEYFRAME;
+        for (size_t index = 6; index < fields.size(); index++) {
+            if (fields[index].compare(0, 2, "F=") == 0) {
+                const unsigned long flags = std::strtoul(fields[index].c_str() + 2, nullptr, 16);
+                entry.flags = (flags & 1) ? static_cast<uint32_t>(ofxFFmpegKeyframeIndexEntry::KEYFRAME) : 0;
+            }
         }
-    }
 
-    const std::string time = std::to_string(hour) + ":" + std::to_string(minute) + ":" + std::to_string(second);
-    std::vector<std::string> args;
+        index->append(entry);
+        offset += size;
+    }
 
-    args.push_back("-i " + videoFilePath);
-    args.push_back("-ss " + time);
-    args.push_back("-vframes 1");
+    fclose(file);
+    index->close();
+#else
+    (void)fd;
+    (void)index;
+    (void)fps;
+#endif
+}
 
-    std::string vfString = "\"";
-    if (size.x > 0 && size.y > 0) {
-        vfString += "scale=" + std::to_string(size.x) + ":" + std::to_string(size.y);
+void ofxFFmpegRecorder::joinKeyframeIndexReader()
+{
+    if (m_KeyframeIndexThread.joinable()) {
+        m_KeyframeIndexThread.join();
     }
 
-    if (crop.isZero() == false) {
-        // Decide if a comma is required.
-        if (vfString.length() > 1) {
-            vfString += ",";
+#if !defined(_WIN32)
+    // If ffmpeg could not be started, the pipe is never read.
+    for (int &fd : m_KeyframeIndexPipe) {
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
         }
+    }
+#endif
 
-        vfString += "crop=" + std::to_string(crop.getWidth()) + ":" + std::to_string(crop.getHeight());
-        if (crop.getX() > 0 && crop.getY() > 0) {
-            vfString += ":" + std::to_string(crop.getX()) + ":" + std::to_string(crop.getY());
-        }
+    if (m_KeyframeIndex) {
+        m_KeyframeIndex->close();
+        m_KeyframeIndex.reset();
     }
+}
 
-    vfString += "\"";
+void ofxFFmpegRecorder::openPreviewPipe(std::vector<std::string> &args)
+{
+    if (m_PreviewSize.x <= 0 || m_PreviewSize.y <= 0 || m_IsRecordVideo == false) {
+        return;
+    }
 
-    if (vfString.length() > 2) {
-        args.push_back("-vf " + vfString);
+#if defined(_WIN32)
+    LOG_WARNING("The preview of the recording is not supported on Windows.");
+#else
+    if (ofxFFmpegCreatePipe(m_PreviewPipe) == false) {
+        LOG_WARNING("Cannot create the preview pipe. The preview will not be available.");
+        m_PreviewPipe[0] = -1;
+        m_PreviewPipe[1] = -1;
+        return;
     }
 
-    args.push_back(output);
+    const std::string width = std::to_string(static_cast<unsigned int>(m_PreviewSize.x));
+    const std::string height = std::to_string(static_cast<unsigned int>(m_PreviewSize.y));
+    args.push_back("-map 0:v -an");
+    args.push_back("-vf \"fps=" + std::to_string(m_PreviewFps) + ",scale=" + width + ":" + height + "\"");
+    args.push_back("-f rawvideo -pix_fmt rgb24 pipe:" + std::to_string(m_PreviewPipe[1]));
+#endif
+}
 
-    std::string cmd = m_FFmpegPath + " ";
-    for (auto arg : args) {
-        cmd += arg + " ";
+void ofxFFmpegRecorder::startPreviewReader()
+{
+#if !defined(_WIN32)
+    if (m_PreviewPipe[1] < 0) {
+        return;
     }
-    
-#if defined(_WIN32)
-    FILE *file = _popen(cmd.c_str(), "w");
-    _pclose(file);
-#else
-    FILE *file = popen(cmd.c_str(), "w");
-    pclose(file);
+
+    if (m_DefaultRecordingFile == nullptr) {
+        joinPreviewReader();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_PreviewMutex);
+        m_PreviewPixels.clear();
+        m_PreviewFrameCount = 0;
+        m_LastPreviewFrame = 0;
+    }
+
+    // Close our copy of the write end so the reader gets EOF when ffmpeg exits.
+    close(m_PreviewPipe[1]);
+    m_PreviewPipe[1] = -1;
+    m_PreviewThread = std::thread(&ofxFFmpegRecorder::processPreview, this);
 #endif
-    
 }
 
-void ofxFFmpegRecorder::determineDefaultDevices()
+void ofxFFmpegRecorder::processPreview()
 {
-    if (m_IsRecordVideo && m_DefaultVideoDevice.deviceName.length() == 0) {
-        ofVideoGrabber videoGrabber;
-        const std::vector<ofVideoDevice> devices = videoGrabber.listDevices();
+#if !defined(_WIN32)
+    // The frame is read into a back buffer that is swapped with m_PreviewPixels when it is complete. The pipe is always drained, so
+    // ffmpeg never waits for the preview.
+    const size_t width = static_cast<size_t>(m_PreviewSize.x);
+    const size_t height = static_cast<size_t>(m_PreviewSize.y);
+    ofPixels frame;
+    frame.allocate(width, height, OF_PIXELS_RGB);
+    const size_t length = frame.getTotalBytes();
+    size_t offset = 0;
+    while (true) {
+        const ssize_t count = read(m_PreviewPipe[0], frame.getData() + offset, length - offset);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
 
-        for (const ofVideoDevice &device : devices) {
-            if (device.bAvailable) {
-                m_DefaultVideoDevice = device;
-                break;
-            }
+        if (count <= 0) {
+            break;
+        }
+
+        offset += count;
+        if (offset < length) {
+            continue;
         }
+
+        {
+            std::lock_guard<std::mutex> lock(m_PreviewMutex);
+            std::swap(m_PreviewPixels, frame);
+            m_PreviewFrameCount++;
+        }
+
+        if (frame.isAllocated() == false) {
+            frame.allocate(width, height, OF_PIXELS_RGB);
+        }
+
+        offset = 0;
     }
 
-    if (m_IsRecordAudio && m_DefaultAudioDevice.isDefaultInput == false) {
-        ofSoundStream soundStream;
-        const std::vector<ofSoundDevice> audoDevices = soundStream.getDeviceList();
+    close(m_PreviewPipe[0]);
+    m_PreviewPipe[0] = -1;
+#endif
+}
 
-        for (const ofSoundDevice &device : audoDevices) {
-            if (device.isDefaultInput) {
-                m_DefaultAudioDevice = device;
-                break;
-            }
+void ofxFFmpegRecorder::joinPreviewReader()
+{
+    if (m_PreviewThread.joinable()) {
+        m_PreviewThread.join();
+    }
+
+#if !defined(_WIN32)
+    for (int &fd : m_PreviewPipe) {
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
         }
     }
+#endif
 }
 
-void ofxFFmpegRecorder::processFrame()
+void ofxFFmpegRecorder::applyWriterThreadSettings()
 {
-    while (isRecording()) {
-        ofPixels *pixels = nullptr;
-        if (m_Frames.consume(pixels) && pixels) {
-            const unsigned char *data = pixels->getData();
-            const size_t dataLength = m_VideoSize.x * m_VideoSize.y * 3;
-            const size_t written = fwrite(data, sizeof(char), dataLength, m_CustomRecordingFile);
-            if (written <= 0) {
-                LOG_WARNING("Cannot write the frame.");
-            }
+    if (m_WriterThreadAffinity.empty() == false) {
+#if defined(__linux__)
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        for (int cpu : m_WriterThreadAffinity) {
+            CPU_SET(cpu, &cpuSet);
+        }
+
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) != 0) {
+            LOG_WARNING("Cannot set the affinity of the writer thread.");
+        }
+#elif defined(_WIN32)
+        DWORD_PTR mask = 0;
+        for (int cpu : m_WriterThreadAffinity) {
+            mask |= static_cast<DWORD_PTR>(1) << cpu;
+        }
+
+        if (SetThreadAffinityMask(GetCurrentThread(), mask) == 0) {
+            LOG_WARNING("Cannot set the affinity of the writer thread.");
+        }
+#else
+        LOG_WARNING("Setting the affinity of the writer thread is not supported on this platform.");
+#endif
+    }
 
-            pixels->clear();
-            delete pixels;
+    if (m_WriterThreadPriority != 0) {
+#if defined(__linux__)
+        // On Linux the nice value is per thread.
+        if (setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), m_WriterThreadPriority) != 0) {
+            LOG_WARNING("Cannot set the priority of the writer thread.");
+        }
+#elif defined(_WIN32)
+        const int priority = m_WriterThreadPriority < 0 ? THREAD_PRIORITY_ABOVE_NORMAL : THREAD_PRIORITY_BELOW_NORMAL;
+        if (SetThreadPriority(GetCurrentThread(), priority) == 0) {
+            LOG_WARNING("Cannot set the priority of the writer thread.");
         }
+#else
+        sched_param param;
+        int policy = 0;
+        pthread_getschedparam(pthread_self(), &policy, &param);
+        const int minPriority = sched_get_priority_min(policy);
+        const int maxPriority = sched_get_priority_max(policy);
+
+        // Map the nice value (-20 is the highest, 19 is the lowest) to the range of the scheduling policy.
+        param.sched_priority = maxPriority - (m_WriterThreadPriority + 20) * (maxPriority - minPriority) / 39;
+        if (pthread_setschedparam(pthread_self(), policy, &param) != 0) {
+            LOG_WARNING("Cannot set the priority of the writer thread.");
+        }
+#endif
     }
 }
 
-void ofxFFmpegRecorder::processBuffer()
+std::string ofxFFmpegRecorder::getEncoderCommandPrefix() const
 {
-    while (isRecording()) {
-        ofSoundBuffer *buffer = nullptr;
-        if (m_Buffers.consume(buffer) && buffer) {
-            //const float *data = buffer->getBuffer().data();
-            //const size_t dataLength = buffer->getBuffer().size();
-            const size_t written = fwrite(&buffer->getBuffer()[0], sizeof(float), buffer->getBuffer().size(), m_CustomRecordingFile);
-            if (written <= 0) {
-                LOG_WARNING("Cannot write the buffer.");
-            }
-            buffer->clear();
-            delete buffer;
+    std::string prefix;
+#if defined(_WIN32)
+    if (m_EncoderNiceLevel != 0 || m_EncoderCpuSet.empty() == false) {
+        LOG_WARNING("The nice level and the CPU set of ffmpeg are not supported on Windows.");
+    }
+#else
+    if (m_EncoderCpuSet.empty() == false) {
+#if defined(__linux__)
+        std::string cpus;
+        for (int cpu : m_EncoderCpuSet) {
+            cpus += (cpus.empty() ? "" : ",") + std::to_string(cpu);
         }
+
+        prefix += "taskset -c " + cpus + " ";
+#else
+        LOG_WARNING("The CPU set of ffmpeg is only supported on Linux.");
+#endif
+    }
+
+    if (m_EncoderNiceLevel != 0) {
+        prefix += "nice -n " + std::to_string(m_EncoderNiceLevel) + " ";
     }
+#endif
+
+    return prefix;
 }
 
 void ofxFFmpegRecorder::joinThread()
@@ -841,3 +3722,21 @@ void ofxFFmpegRecorder::joinThread()
         m_Thread.join();
     }
 }
+
+void ofxFFmpegRecorder::joinLiveThumbnails()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_LiveThumbnailMutex);
+        m_IsLiveThumbnailRunning = false;
+        if (m_LiveThumbnails.empty() == false) {
+            LOG_WARNING("The recording is stopped before the requested live thumbnails were written.");
+            m_LiveThumbnails.clear();
+            m_HasLiveThumbnails = false;
+        }
+    }
+
+    m_LiveThumbnailCondition.notify_one();
+    if (m_LiveThumbnailThread.joinable()) {
+        m_LiveThumbnailThread.join();
+    }
+}
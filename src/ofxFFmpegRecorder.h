@@ -7,8 +7,25 @@
 #include "ofSoundBuffer.h"
 #include "ofRectangle.h"
 #include "ofPixels.h"
+#include "ofImage.h"
+
+#include "ofxFFmpegFramePool.h"
+#include "ofxFFmpegFrameSink.h"
+#include "ofxFFmpegWriterPool.h"
+#include "ofxFFmpegSpillFile.h"
+#include "ofxFFmpegChunkedSink.h"
+#include "ofxFFmpegCapabilities.h"
+#include "ofxFFmpegKeyframeIndex.h"
 
 #include <thread>
+#include <mutex>
+#include <atomic>
+#include <array>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <condition_variable>
+#include <future>
 
 using HighResClock = std::chrono::time_point<std::chrono::high_resolution_clock>;
 
@@ -39,7 +56,8 @@ struct LockFreeQueue {
         ++nextIt;
         if (nextIt != m_TailIt) {
             m_HeadIt = nextIt;
-            t = *m_HeadIt;
+            // Moving releases the queue's reference, the head element is only erased by the next produce()
+            t = std::move(*m_HeadIt);
             return true;
         }
 
@@ -67,6 +85,257 @@ private:
     typename TList::iterator m_HeadIt, m_TailIt;
 };
 
+/**
+ * @brief A snapshot of the performance counters of a recording. See ofxFFmpegRecorder::getStats().
+ */
+struct ofxFFmpegRecorderStats {
+    /**
+     * @brief Bucket i of the write latency histogram counts the writes that took [2^i, 2^(i + 1)) microseconds. The first bucket
+     * also counts the faster writes and the last one the slower writes.
+     */
+    static const size_t WriteLatencyBucketCount = 20;
+
+    size_t queuedFrames = 0, maxQueuedFrames = 0;
+
+    /**
+     * @brief The bytes of the queued frames. A duplicate or a static frame shares the buffer of the frame before it, so it is not counted
+     * again.
+     */
+    size_t queuedBytes = 0, maxQueuedBytes = 0;
+
+    /**
+     * @brief addedFrames is the number of frames that are queued. duplicatedFrames and droppedFrames are the frames that are
+     * repeated or skipped by the pacing in addFrame() to keep up with the fps.
+     */
+    uint64_t addedFrames = 0, duplicatedFrames = 0, droppedFrames = 0;
+
+    /**
+     * @brief The frames that were the same as the previous frame and were not copied. See ofxFFmpegRecorder::setSkippingStaticFrames().
+     */
+    uint64_t staticFrames = 0;
+
+    /**
+     * @brief The duplicates and the static frames that were not written to ffmpeg in the variable frame rate mode of
+     * ofxFFmpegRecorder::setSkippingStaticFrames().
+     */
+    uint64_t unwrittenFrames = 0;
+
+    /**
+     * @brief The frames that were not recorded because there was no motion. See ofxFFmpegRecorder::setMotionTrigger().
+     */
+    uint64_t motionSkippedFrames = 0;
+
+    /**
+     * @brief The frames that were compressed in the queue and the memory that it saved. See
+     * ofxFFmpegRecorder::setCompressingQueuedFrames().
+     */
+    uint64_t compressedFrames = 0, compressionSavedBytes = 0;
+
+    /**
+     * @brief The frames that were written to the spill file because the queue was over its memory budget, and how many of them are
+     * still in the file. See ofxFFmpegRecorder::setQueueMemoryBudget().
+     */
+    uint64_t spilledFrames = 0;
+    size_t queuedSpilledFrames = 0;
+
+    uint64_t writtenFrames = 0, writtenBytes = 0;
+    std::array<uint64_t, WriteLatencyBucketCount> writeLatencyHistogram{};
+
+    /**
+     * @brief Bytes per second written to ffmpeg since the recording started.
+     */
+    float pipeThroughput = 0.f;
+
+    /**
+     * @brief These are reported by ffmpeg's progress output and they are zero until ffmpeg reports its first progress.
+     */
+    uint64_t encodedFrames = 0;
+    float encoderFps = 0.f, encoderSpeed = 0.f;
+
+    size_t poolAllocatedFrames = 0, poolFreeFrames = 0;
+};
+
+enum ofxFFmpegStreamProtocol {
+    OFX_FFMPEG_STREAM_RTP,
+    OFX_FFMPEG_STREAM_MPEGTS_UDP,
+    OFX_FFMPEG_STREAM_SRT,
+    OFX_FFMPEG_STREAM_RTMP
+};
+
+/**
+ * @brief Settings of ofxFFmpegRecorder::startCustomStreaming(). The default settings stream RTP to rtp://127.0.0.1:1234.
+ * **Example Usage**
+ * @code
+ *     // A low latency preview that ofxFFmpegLatencyProbe or "ffplay -fflags nobuffer udp://127.0.0.1:1234" can receive.
+ *     ofxFFmpegStreamSettings settings;
+ *     settings.protocol = OFX_FFMPEG_STREAM_MPEGTS_UDP;
+ *     settings.url = "udp://127.0.0.1:1234?pkt_size=1316";
+ *     settings.videoCodec = "libx264";
+ *     settings.preset = "ultrafast";
+ *     settings.zeroLatency = true;
+ *     settings.gopSize = 30;
+ *     settings.bFrames = 0;
+ *     settings.flushPackets = true;
+ *     recorder.setStreamSettings(settings);
+ * @endcode
+ */
+struct ofxFFmpegStreamSettings {
+    /**
+     * @brief RTP is sent as is, UDP and SRT are sent as MPEG-TS and RTMP is sent as FLV. url must use the matching protocol, e.g.
+     * "srt://127.0.0.1:9000" or "rtmp://127.0.0.1/live/stream" for a local server.
+     */
+    ofxFFmpegStreamProtocol protocol = OFX_FFMPEG_STREAM_RTP;
+    std::string url = "rtp://127.0.0.1:1234";
+
+    /**
+     * @brief The codec and the preset are not set if they are empty, so ffmpeg uses the default of the format.
+     */
+    std::string videoCodec, preset;
+
+    /**
+     * @brief "-tune zerolatency". This is supported by libx264 and libx265.
+     */
+    bool zeroLatency = false;
+
+    /**
+     * @brief The keyframe interval in frames and the number of B-frames. They are not set if they are negative. B-frames add at least one
+     * frame of latency, so use 0 for the lowest latency.
+     */
+    int gopSize = -1, bFrames = -1;
+
+    /**
+     * @brief If this is true, the muxer writes every packet as soon as it is ready instead of buffering them.
+     */
+    bool flushPackets = false;
+};
+
+enum ofxFFmpegLadderFormat {
+    OFX_FFMPEG_LADDER_HLS,
+    OFX_FFMPEG_LADDER_DASH
+};
+
+/**
+ * @brief A rendition of ofxFFmpegLadderSettings.
+ */
+struct ofxFFmpegRendition {
+    /**
+     * @brief The size of the rendition. If the width or the height is 0, it is calculated from the other one with the aspect ratio of the
+     * recording, rounded to an even number. If both are 0, the size of the recording is used.
+     */
+    glm::vec2 size = glm::vec2(0, 0);
+
+    /**
+     * @brief The bit rate in kbps. This is also the maximum rate, and the rate control buffer holds two seconds at this rate.
+     */
+    unsigned int bitRate = 2000;
+
+    /**
+     * @brief The "-preset" of the encoder (e.g. "veryfast" for libx264/libx265). Not set if empty.
+     */
+    std::string preset;
+};
+
+/**
+ * @brief Settings of the rendition ladder of startCustomRecord() and startCustomStreaming(). When there is at least one rendition, the
+ * frames are sent to a single ffmpeg process that splits them in its filter graph, scales and encodes each rendition with the recording's
+ * codec and writes the HLS or DASH segments to a local directory, e.g. for a local server or a test of an adaptive player. The keyframes
+ * of the renditions are aligned to the segments so that a player can switch between them. The output path, the stream settings, the
+ * adaptive encoding and the chunked encoding are not used in this mode.
+ * **Example Usage**
+ * @code
+ *     ofxFFmpegLadderSettings settings;
+ *     settings.directory = ofToDataPath("hls", true);
+ *     settings.renditions.push_back({glm::vec2(1920, 1080), 6000, "veryfast"});
+ *     settings.renditions.push_back({glm::vec2(0, 720), 3000, "veryfast"});
+ *     settings.renditions.push_back({glm::vec2(0, 360), 800, "veryfast"});
+ *     recorder.setLadderSettings(settings);
+ *     recorder.startCustomRecord();
+ *     // Play recorder.getLadderPlaylistPath().
+ * @endcode
+ */
+struct ofxFFmpegLadderSettings {
+    std::vector<ofxFFmpegRendition> renditions;
+    ofxFFmpegLadderFormat format = OFX_FFMPEG_LADDER_HLS;
+
+    /**
+     * @brief The segments are written here. HLS writes master.m3u8 and a "stream_<index>" directory for each rendition, DASH writes
+     * manifest.mpd and the segments of all the renditions. The directory is created if it does not exist.
+     */
+    std::string directory;
+
+    /**
+     * @brief The duration of a segment in seconds.
+     */
+    float segmentDuration = 2.f;
+
+    /**
+     * @brief If this is more than 0, the playlists only keep the last playlistSize segments and the older segments are deleted, as in a
+     * live stream. If it is 0, all the segments are kept.
+     */
+    size_t playlistSize = 0;
+};
+
+/**
+ * @brief The encoder settings of a level of the adaptive encoding. See ofxFFmpegAdaptiveSettings.
+ */
+struct ofxFFmpegAdaptiveLevel {
+    /**
+     * @brief The "-preset" of the encoder (e.g. "veryfast" for libx264/libx265). Not set if empty.
+     */
+    std::string preset;
+
+    /**
+     * @brief If this is not negative, "-crf" is used instead of the bit rate.
+     */
+    int crf = -1;
+
+    /**
+     * @brief These are multiplied with the bit rate, the fps and the size of the recording. The input frames are still added with the
+     * recording's fps and size, ffmpeg drops the frames and scales them down.
+     */
+    float bitRateScale = 1.f, fpsScale = 1.f, sizeScale = 1.f;
+};
+
+/**
+ * @brief Settings of the adaptive encoding that keeps the custom recording real-time. When the writer queue grows or ffmpeg reports a
+ * speed that is slower than real-time for long enough, the recorder switches to the next (cheaper) level. When the encoder keeps up
+ * again for long enough, it switches back. A switch starts a new ffmpeg process that writes a new segment file, see
+ * ofxFFmpegRecorder::getSegmentPaths(). The last level is the floor, the recorder never goes below it.
+ * **Example Usage**
+ * @code
+ *     ofxFFmpegAdaptiveSettings settings;
+ *     settings.levels.push_back({"veryfast", 23});
+ *     settings.levels.push_back({"superfast", 26});
+ *     settings.levels.push_back({"ultrafast", 28, 1.f, 0.5f});
+ *     settings.levels.push_back({"ultrafast", 30, 1.f, 0.5f, 0.5f});
+ *     recorder.setAdaptiveSettings(settings);
+ * @endcode
+ */
+struct ofxFFmpegAdaptiveSettings {
+    /**
+     * @brief The levels from the best quality to the cheapest one. The recording starts with the first level. The adaptive encoding is
+     * disabled if there is less than two levels.
+     */
+    std::vector<ofxFFmpegAdaptiveLevel> levels;
+
+    /**
+     * @brief The encoder is behind if more than maxQueuedFrames frames are waiting or its speed is below minSpeed. It keeps up if at
+     * most minQueuedFrames frames are waiting and its speed is at least recoverSpeed.
+     */
+    size_t maxQueuedFrames = 30, minQueuedFrames = 2;
+    float minSpeed = 0.95f, recoverSpeed = 1.2f;
+
+    /**
+     * @brief How many seconds the encoder must be behind to step down a level, and how many seconds it must keep up to step up a level.
+     */
+    float stepDownDelay = 1.f, stepUpDelay = 10.f;
+
+    /**
+     * @brief The minimum duration of a segment in seconds.
+     */
+    float minSegmentDuration = 5.f;
+};
+
 class ofxFFmpegRecorder
 {
 public:
@@ -94,6 +363,20 @@ public:
     void setFFmpegPath(const std::string &path);
     void setFFmpegPathToAddonsPath();
 
+    /**
+     * @brief Returns what the ffmpeg binary supports. It is probed on the first call after the path is changed, or read from the cache
+     * file if the binary is probed before. See ofxFFmpegCapabilities.
+     * @return
+     */
+    std::shared_ptr<const ofxFFmpegCapabilities> getCapabilities();
+
+    /**
+     * @brief Starts probing the ffmpeg binary on a background thread. Probing a binary that is not cached runs it a few times and test
+     * encodes with each hardware encoder, which can take a few seconds. Call this after the ffmpeg path is set so that setVideoCodec()
+     * can check the codec, and so that the first getCapabilities() call or the start of the first recording does not wait for it.
+     */
+    void probeCapabilities();
+
     float getCaptureDuration() const;
     void setCaptureDuration(float duration);
 
@@ -113,10 +396,186 @@ public:
     void setBitRate(unsigned int rate);
 
     std::string getVideoCodec() const;
-    void setVideoCodec(const std::string &codec);
+
+    /**
+     * @brief Sets the encoder of the custom recording. The codec is checked against the capabilities of the ffmpeg binary. If it is not an
+     * encoder but a family such as "h264" or "hevc", the fastest encoder of the family that works on this machine is used. If the binary
+     * cannot be probed, the codec is used as is.
+     *
+     * This does not run the binary. If its capabilities are not in memory, in the cache file or probed by probeCapabilities(), the codec
+     * is checked when the recording starts, and the recording does not start if the binary does not support it.
+     * @param codec
+     * @return Returns false if the binary does not support the codec. The codec is not changed in that case.
+     */
+    bool setVideoCodec(const std::string &codec);
 
     void setAudioConfig(int bufferSize, int sampleRate);
 
+    bool isFragmentedOutput() const;
+    float getFragmentDuration() const;
+
+    /**
+     * @brief If this is true, startCustomRecord() writes the output as fragments of fragmentDuration seconds, each starting with a
+     * keyframe. MP4/MOV files are written as fragmented MP4 and MKV/WebM files use clusters of the same duration. stop() does not have
+     * to rewrite the file, and if the application crashes the file is still playable up to the last complete fragment. Other formats
+     * only get the keyframes. The default value is false.
+     * @param fragmented
+     * @param fragmentDuration In seconds.
+     */
+    void setFragmentedOutput(bool fragmented, float fragmentDuration = 1.f);
+
+    bool isWritingKeyframeIndex() const;
+
+    /**
+     * @brief If this is true, startCustomRecord() writes an ofxFFmpegKeyframeIndex next to the output file while it records, with the
+     * pts, the offset and the keyframe flag of each encoded packet. The packets are taken from a second output of ffmpeg's tee muxer,
+     * so the muxer options in the additional output arguments are not applied to the file in this mode. This is not supported with the
+     * chunked encoding, the rendition ladder or on Windows. The default value is false.
+     * @param writing
+     */
+    void setWritingKeyframeIndex(bool writing);
+
+    bool isSkippingStaticFrames() const;
+    bool isVariableFrameRate() const;
+
+    /**
+     * @brief If skip is true, addFrame() compares each frame with the previous one and if they are the same, the previous copy is queued
+     * again instead of copying the frame. This is useful for mostly static content such as UI. The comparison stops at the first
+     * difference, so it is cheap for the frames that changed. The default value is false.
+     *
+     * The raw video input of ffmpeg has a constant frame rate, so the repeats are still written to the pipe. If variableFrameRate is
+     * also true, the repeats and the duplicates of the pacing are not written. ffmpeg stamps each frame with the time that it reads it
+     * (-use_wallclock_as_timestamps) and the fps filter repeats the previous frame until the next one, so the video still has the fps
+     * of the recording. A repeat is written every second, and the last frame is written again when the recording stops. The timing is
+     * only as exact as the writer keeps up with addFrame(), so this is for content that the encoder can keep up with. The variable frame
+     * rate mode is only used by startCustomRecord(), not in the offline mode, with the chunked encoding or the rendition ladder. It takes
+     * effect with the next recording.
+     * @param skip
+     * @param variableFrameRate
+     */
+    void setSkippingStaticFrames(bool skip, bool variableFrameRate = false);
+
+    float getMotionThreshold() const;
+    float getMotionPreRoll() const;
+    float getMotionPostRoll() const;
+
+    /**
+     * @brief If threshold is more than 0, addFrame() only records while there is motion. Every rowStep-th row of each frame is compared
+     * with the same rows of the previous frame, and if their mean absolute difference per byte (from 0 to 255) is at least threshold,
+     * the recording continues for postRoll more seconds. The frames without motion are not copied or sent to ffmpeg, and the time
+     * without motion is left out of the video. The last preRoll seconds before the motion are kept in memory at the fps of the
+     * recording and are recorded when the motion starts. This can be changed during the recording, the time that was already left out
+     * stays out when the trigger is disabled. It does not apply to
+     * submitFrame(). The default threshold is 0.
+     * @param threshold
+     * @param preRoll In seconds.
+     * @param postRoll In seconds.
+     * @param rowStep
+     */
+    void setMotionTrigger(float threshold, float preRoll = 2.f, float postRoll = 5.f, size_t rowStep = 4);
+
+    /**
+     * @brief Returns true while the motion trigger is recording.
+     * @return
+     */
+    bool isMotionActive() const;
+
+    /**
+     * @brief Returns the difference of the last frame that addFrame() compared, see setMotionTrigger().
+     * @return
+     */
+    float getMotionLevel() const;
+
+    bool isCompressingQueuedFrames() const;
+    size_t getCompressionThreshold() const;
+
+    /**
+     * @brief If this is true, a frame that is queued behind queuedFramesThreshold or more frames is compressed losslessly on a background
+     * thread, and it is decompressed right before it is written to ffmpeg. When the encoder falls behind, this uses a spare core to keep
+     * the memory of the queue several times lower. Only RGB, BGR, RGBA and BGRA frames are compressed, and the frames are not compressed
+     * while setSkippingStaticFrames() is enabled. The default value is false.
+     * @param compress
+     * @param queuedFramesThreshold
+     */
+    void setCompressingQueuedFrames(bool compress, size_t queuedFramesThreshold = 4);
+
+    size_t getQueueMemoryBudget() const;
+
+    /**
+     * @brief Limits the memory of the frames that wait for ffmpeg. The frames that would go over budgetBytes are written to a memory
+     * mapped spill file instead, and the writer thread reads them back in order, so no frame is lost during a burst that the encoder
+     * cannot keep up with. If the spill file is also full, the frames are kept in memory. 0 disables the budget, which is the default.
+     * This is only supported on Linux and macOS.
+     * @param budgetBytes
+     * @param spillFileBytes The size of the spill file. The file is sparse, so only the spilled frames take disk space.
+     * @param spillPath Where the spill file is created. It is deleted right away, so it never shows up in the directory. If this is
+     * empty, the file is created next to the output file.
+     */
+    void setQueueMemoryBudget(size_t budgetBytes, size_t spillFileBytes = 4ull * 1024 * 1024 * 1024, const std::string &spillPath = "");
+
+    const ofxFFmpegAdaptiveSettings &getAdaptiveSettings() const;
+
+    /**
+     * @brief Sets the adaptive encoding of startCustomRecord(). See ofxFFmpegAdaptiveSettings. This is not supported with a writer pool.
+     * @param settings
+     */
+    void setAdaptiveSettings(const ofxFFmpegAdaptiveSettings &settings);
+
+    /**
+     * @brief Returns the index of the adaptive encoding level that is in use.
+     * @return
+     */
+    size_t getAdaptiveLevel() const;
+
+    /**
+     * @brief Returns the files of the current or the last custom recording. The first one is the output path, and a new segment is added
+     * every time the adaptive encoding switches the level, named as the output path with the index of the segment appended.
+     * @return
+     */
+    std::vector<std::string> getSegmentPaths() const;
+
+    const std::vector<int> &getWriterThreadAffinity() const;
+
+    /**
+     * @brief Pins the writer thread to the given CPUs, e.g. to keep it away from the render thread's core. An empty list lets the
+     * thread run on any CPU. This is not supported on macOS and it does not affect an ofxFFmpegWriterPool.
+     * @param cpus
+     */
+    void setWriterThreadAffinity(const std::vector<int> &cpus);
+
+    int getWriterThreadPriority() const;
+
+    /**
+     * @brief Sets the scheduling priority of the writer thread as a nice value, from -20 (highest) to 19 (lowest). 0 leaves the
+     * priority unchanged. Raising the priority above normal may require elevated privileges.
+     * @param priority
+     */
+    void setWriterThreadPriority(int priority);
+
+    int getEncoderNiceLevel() const;
+
+    /**
+     * @brief Starts ffmpeg with the given nice level (through "nice -n"). 0 leaves the priority unchanged. This is not supported on Windows.
+     * @param level
+     */
+    void setEncoderNiceLevel(int level);
+
+    const std::vector<int> &getEncoderCpuSet() const;
+
+    /**
+     * @brief Restricts ffmpeg to the given CPUs (through "taskset -c"). This is only supported on Linux.
+     * @param cpus
+     */
+    void setEncoderCpuSet(const std::vector<int> &cpus);
+
+    unsigned int getEncoderThreads() const;
+
+    /**
+     * @brief Sets the "-threads" output argument of ffmpeg. 0 lets ffmpeg decide.
+     * @param threads
+     */
+    void setEncoderThreads(unsigned int threads);
+
 	float getWidth();
 	void setWidth(float aw);
 	float getHeight();
@@ -125,7 +584,63 @@ public:
     bool isPaused() const;
     void setPaused(bool paused);
 
-	void setPixelFormat(ofImageType aType);
+    bool isOffline() const;
+    size_t getOfflineMaxQueuedFrames() const;
+
+    /**
+     * @brief If this is true, addFrame() is not paced by the clock, each call adds exactly one frame, or the frames up to the given pts.
+     * When maxQueuedFrames frames are waiting for ffmpeg, addFrame() blocks until the writer catches up, so an offline render runs
+     * as fast as it can be encoded without dropping or duplicating frames. The default value is false.
+     * @param offline
+     * @param maxQueuedFrames
+     */
+    void setOffline(bool offline, size_t maxQueuedFrames = 8);
+
+    size_t getChunkedProcessCount() const;
+    size_t getChunkFrames() const;
+
+    /**
+     * @brief If processCount is more than 1, startCustomRecord() encodes the video with that many ffmpeg processes in parallel. The frames
+     * are split into chunks of chunkFrames frames that are encoded to separate files, and stop() joins them into the output file without
+     * encoding them again. This is meant for the offline mode, where it uses the cores that a single encoder cannot. Up to chunkFrames
+     * frames are kept in memory for each process, so keep the chunks short, e.g. a few GOPs. setEncoderThreads() applies to each process.
+     * The adaptive encoding and the encoder stats are not available in this mode. The default process count is 1.
+     * @param processCount
+     * @param chunkFrames
+     */
+    void setChunkedEncoding(size_t processCount, size_t chunkFrames = 120);
+
+    /**
+     * @brief Returns how many seconds of video are recorded for each second of real time. This is 1 unless a time scale or a timelapse
+     * interval is set.
+     */
+    float getTimeScale() const;
+
+    /**
+     * @brief Scales the time that the pacing of addFrame() uses. Above 1 the video plays slower than real time, e.g. with 4 each frame
+     * of a 120 fps camera becomes one frame of a 30 fps video. Below 1 the video is sped up and addFrame() only copies the frames that
+     * are kept, the rest return 0 without being copied. This clears the timelapse interval. When it is changed during a recording, the
+     * new scale applies from the time of the change.
+     * @param scale
+     */
+    void setTimeScale(float scale);
+
+    float getTimelapseInterval() const;
+
+    /**
+     * @brief Keeps one frame every interval seconds for a timelapse. addFrame() can still be called every frame, only the frame of each
+     * interval is copied. This overrides the time scale, 0 disables it. When it is changed during a recording, the new interval applies
+     * from the time of the change.
+     * @param interval In seconds.
+     */
+    void setTimelapseInterval(float interval);
+
+    /**
+     * @brief Sets the pixel format of the frames that are added. OF_IMAGE_COLOR is rgb24 and OF_IMAGE_GRAYSCALE is gray.
+     * @param aType
+     * @return Returns false if the type is not supported, rgb24 is used then.
+     */
+	bool setPixelFormat(ofImageType aType);
 
     /**
      * @brief Returns the record duration for the custom recording. This will return 0 for the webcam recording.
@@ -146,6 +661,30 @@ public:
      */
     bool record(float duration = 0);
 
+    glm::vec2 getPreviewSize() const;
+    float getPreviewFps() const;
+
+    /**
+     * @brief If size is not zero, record() also makes ffmpeg output a scaled down raw RGB copy of the video device at the given fps.
+     * The preview is read on a background thread and the newest frame is returned by getPreviewPixels(), so the device does not have to be
+     * opened a second time with ofVideoGrabber. This is not supported on Windows. The default size is zero.
+     * @param size
+     * @param fps
+     */
+    void setPreview(glm::vec2 size, float fps = 10.f);
+
+    /**
+     * @brief Copies the newest preview frame of record() into pixels.
+     * @param pixels
+     * @return Returns false if there is no new preview frame since the last call.
+     */
+    bool getPreviewPixels(ofPixels &pixels);
+
+    /**
+     * @brief Returns the number of preview frames that were received since record() was called.
+     */
+    uint64_t getPreviewFrameCount() const;
+
     /**
      * @brief Setup ffmpeg for a custom video recording. Input is taken from the stdin as raw image. This also inherits the
      * m_AdditionalArguments.
@@ -153,6 +692,32 @@ public:
      */
     bool startCustomRecord();
 
+    /**
+     * @brief Starts a custom video recording that writes the frames to the given sink instead of ffmpeg. The frames are paced the same
+     * way as the ffmpeg recording. The output path and the codec settings are not used.
+     * @param sink
+     * @return If the class was already recording a video/audio this method returns false, otherwise it returns true;
+     */
+    bool startCustomRecord(std::shared_ptr<ofxFFmpegFrameSink> sink);
+
+    /**
+     * @brief Adds a sink that receives the same frames as ffmpeg (or the sink given to startCustomRecord()) in the next custom video
+     * recording. The frames are not copied for the sinks. The sinks are closed and removed when the recording is stopped, and they
+     * cannot be added while a recording is in proggress.
+     * @param sink
+     */
+    void addFrameSink(std::shared_ptr<ofxFFmpegFrameSink> sink);
+    void clearFrameSinks();
+
+    std::shared_ptr<ofxFFmpegWriterPool> getWriterPool() const;
+
+    /**
+     * @brief If a writer pool is set, the frames of the custom video recordings are written by the pool's threads instead of a writer
+     * thread that is owned by this recorder. The same pool can be shared by many recorders. Set it to nullptr to use a writer thread again.
+     * @param pool
+     */
+    void setWriterPool(std::shared_ptr<ofxFFmpegWriterPool> pool);
+
     /**
      * @brief Setup ffmpeg for a custom audio recording. This also inherits the
      * m_AdditionalArguments.
@@ -160,9 +725,32 @@ public:
      */
     bool startCustomAudioRecord();
 
+    const ofxFFmpegStreamSettings &getStreamSettings() const;
+
     /**
-     * @brief Setup ffmpeg for a custom video streaming. Input is taken from the stdin as raw image. This also inherits the
-     * m_AdditionalArguments.
+     * @brief Sets the destination and the latency related settings of startCustomStreaming(). See ofxFFmpegStreamSettings.
+     * @param settings
+     */
+    void setStreamSettings(const ofxFFmpegStreamSettings &settings);
+
+    const ofxFFmpegLadderSettings &getLadderSettings() const;
+
+    /**
+     * @brief Sets the rendition ladder that startCustomRecord() and startCustomStreaming() encode instead of a single output. See
+     * ofxFFmpegLadderSettings. Clear the renditions to disable it.
+     * @param settings
+     */
+    void setLadderSettings(const ofxFFmpegLadderSettings &settings);
+
+    /**
+     * @brief Returns the master playlist of the HLS ladder or the manifest of the DASH ladder.
+     * @return
+     */
+    std::string getLadderPlaylistPath() const;
+
+    /**
+     * @brief Setup ffmpeg for a custom video streaming with the stream settings. Input is taken from the stdin as raw image. This also
+     * inherits the m_AdditionalArguments.
      * @return If the class was already recording a video/audio this method returns false, otherwise it returns true;
      */
     bool startCustomStreaming();
@@ -174,6 +762,87 @@ public:
      */
     size_t addFrame(const ofPixels &pixels);
 
+    /**
+     * @brief Add a frame with an explicit presentation time in the offline mode. The frame is placed at the output frame that is closest
+     * to pts. If frames are skipped, the previous frame is repeated until pts, and if pts is not after the last added frame, the frame is
+     * dropped. Without the offline mode this is the same as addFrame(pixels).
+     * @param pixels
+     * @param pts In seconds from the start of the recording.
+     * @return The number of frames that were queued.
+     */
+    size_t addFrame(const ofPixels &pixels, double pts);
+
+    /**
+     * @brief Returns a frame from the frame pool of the recorder, to be filled and added with addFrame(std::shared_ptr<ofPixels>). It may
+     * still have the size and the contents of its previous use, assigning pixels of the same size to it does not reallocate the memory.
+     * @return
+     */
+    std::shared_ptr<ofPixels> acquireFrame();
+
+    /**
+     * @brief The same as addFrame(const ofPixels &), but the frame is queued as it is instead of being copied, which saves a copy when
+     * the frame is built in place, e.g. by ofxFFmpegCompositor. The frame must not be changed after this, use acquireFrame() for the next
+     * one.
+     * @param frame
+     * @return The number of frames that were queued.
+     */
+    size_t addFrame(const std::shared_ptr<ofPixels> &frame);
+
+    /**
+     * @brief Add a frame from any thread, e.g. from the workers of a job system. The frames are queued in the order of their sequence
+     * numbers, which start from 0 for each recording and must not have gaps. Each sequence number is one frame of the video, there is
+     * no pacing by the clock. The frame is copied on the calling thread, and only the reordering is done under a lock. The queued frames
+     * follow the memory budget and the compression the same way as the frames of addFrame(). Do not mix this with addFrame() in the same
+     * recording.
+     *
+     * At most getMaxReorderedFrames() frames wait for a missing one. In the offline mode the frames after them block until the missing
+     * frame is submitted, and the queue is filled one frame at a time so it does not go over its size. Otherwise the missing frames are
+     * counted as dropped and the waiting frames are queued without them.
+     * @param sequence
+     * @param pixels
+     * @return Returns false if the frame cannot be added, or if the sequence number was already added or skipped.
+     */
+    bool submitFrame(uint64_t sequence, const ofPixels &pixels);
+
+    size_t getMaxReorderedFrames() const;
+
+    /**
+     * @brief Sets how many frames of submitFrame() can wait for a frame that is not submitted yet. The default value is 16.
+     * @param frames
+     */
+    void setMaxReorderedFrames(size_t frames);
+
+    /**
+     * @brief Encodes a sequence of images into the output path and returns when the video is finished. This is a whole custom recording
+     * in the offline mode, so the recorder must not be recording. The images are decoded by threadCount threads straight into the frame
+     * pool and queued in order, so the encoder is not limited by the decoding of a single thread. The images that are not the size of the
+     * video are scaled and the images with another type are converted. If the video size is not set, the size of the first image is used.
+     * **Example Usage**
+     * @code
+     *     recorder.setup(true, false, glm::vec2(0, 0), 30);
+     *     recorder.setOutputPath(ofToDataPath("render.mp4", true));
+     *     recorder.setVideoCodec("h264");
+     *     recorder.encodeImageSequence(ofToDataPath("render/frame_%05d.png", true));
+     * @endcode
+     * @param source A directory, whose PNG, JPEG, BMP and TIFF images are encoded in the order of their names, or a printf style pattern
+     * such as "frame_%05d.png" that is numbered from startNumber until an image is missing. If startNumber is 0 and there is no image
+     * 0, the sequence starts from 1. The pattern must have exactly one %d or %0Nd, and a literal % is written as %%.
+     * @param threadCount 0 uses a thread per core.
+     * @param startNumber
+     * @return The number of frames that were encoded. The images that cannot be loaded are skipped.
+     */
+    size_t encodeImageSequence(const std::string &source, size_t threadCount = 0, size_t startNumber = 0);
+
+    /**
+     * @brief Add the region of pixels inside roi to the stream. The rows of the region are copied straight from pixels with its stride,
+     * so the only copy that is made is the one that is queued. The size of roi must be the video size and it must be inside pixels.
+     * pixels must have a single plane, e.g. RGB, RGBA or gray.
+     * @param pixels
+     * @param roi
+     * @return The number of frames that were queued.
+     */
+    size_t addFrame(const ofPixels &pixels, const ofRectangle &roi);
+
     /**
      * @brief Add a sound buffer to the stream. This can onle be used If you started recording a custom audio. Make sure that the buffers are added continuously inside the audioIn thread.
      * @param pixels
@@ -260,8 +929,118 @@ public:
     void saveThumbnail(const unsigned int &hour, const unsigned int &minute, const float &second, const std::string &output, glm::vec2 size = glm::vec2(0, 0),
                        ofRectangle crop = ofRectangle(0, 0, 0, 0), std::string videoFilePath = "");
 
+    /**
+     * @brief Saves a thumbnail for each of the given times (in seconds) using input seeking, so ffmpeg jumps to the nearest keyframe
+     * instead of decoding the video from the start. All thumbnails are extracted by a single ffmpeg process unless maxProcesses is
+     * greater than 1, in which case the times are split between that many processes running in parallel. This call blocks until all
+     * of the thumbnails are saved. The same restrictions as saveThumbnail() apply to videoFilePath.
+     * **Example Usage**
+     * @code
+     *     recorder.saveThumbnails({0.f, 60.f, 120.f}, "thumbnail_%d.png", glm::vec2(320, 180));
+     * @endcode
+     * @param seconds
+     * @param outputPattern "%d" is replaced with the index of the time in seconds. If it is missing, the index is appended to the file name.
+     * @param size
+     * @param crop
+     * @param videoFilePath
+     * @param maxProcesses
+     */
+    void saveThumbnails(const std::vector<float> &seconds, const std::string &outputPattern, glm::vec2 size = glm::vec2(0, 0),
+                        ofRectangle crop = ofRectangle(0, 0, 0, 0), std::string videoFilePath = "", unsigned int maxProcesses = 1);
+
+    /**
+     * @brief Saves a frame of the custom recording that is in proggress without decoding the output file. The frame is taken from the
+     * queue after it is written to ffmpeg and it is encoded on a background thread, so this does not block addFrame(). The format is
+     * determined from the extension of output (e.g. png or jpg).
+     * @param output
+     * @param recordTime The recording time in seconds to take the frame at. If it is negative, the next added frame is used. If the time
+     * has already passed, the next frame that is written is used.
+     * @param quality
+     * @return Returns false if a custom video recording is not in proggress.
+     */
+    bool saveLiveThumbnail(const std::string &output, float recordTime = -1.f, ofImageQualityType quality = OF_IMAGE_QUALITY_BEST);
+
+    /**
+     * @brief Returns a snapshot of the performance counters of the current, or the last, recording. Reading the counters does not
+     * lock, so this can be called every frame (e.g. to draw an overlay).
+     * @return
+     */
+    ofxFFmpegRecorderStats getStats() const;
+
 private:
+    friend class ofxFFmpegWriterPool;
+
+    struct LiveThumbnail {
+        unsigned int frame;
+        std::string output;
+        ofImageQualityType quality;
+    };
+
+    /**
+     * @brief A written frame and the live thumbnails that are taken from it.
+     */
+    struct LiveThumbnailJob {
+        std::shared_ptr<ofPixels> pixels;
+        std::vector<LiveThumbnail> thumbnails;
+    };
+
+    /**
+     * @brief The ffmpeg command of a custom recording, taken when the recording starts. The adaptive encoding starts a process for each
+     * segment from the writer thread, so it uses this instead of the settings that the setters may change during the recording.
+     */
+    struct CustomRecordCommand {
+        std::string program;
+
+        /**
+         * @brief The arguments of each adaptive level without the output path, with the muxer options and without them for the tee
+         * muxer of the keyframe index, which takes muxerOptions instead.
+         */
+        std::vector<std::vector<std::string>> levelArguments, teeLevelArguments;
+        std::vector<std::pair<std::string, std::string>> muxerOptions;
+        ofxFFmpegAdaptiveSettings adaptiveSettings;
+        bool isWritingKeyframeIndex = false;
+        bool isVariableFrameRate = false;
+        float fps = 30.f;
+    };
+
+    /**
+     * @brief A queued frame that is handed to the compression thread. The frame is only cleared when it is Compressed, if the writer
+     * reaches it before that it is Claimed and written as it is.
+     */
+    struct CompressedFrame {
+        enum State {
+            Pending,
+            Compressing,
+            Compressed,
+            Claimed
+        };
+
+        State state = Pending;
+        size_t width = 0, height = 0;
+        ofPixelFormat format = OF_PIXELS_RGB;
+        std::vector<unsigned char> data;
+    };
+
+    struct StatCounters {
+        std::atomic<size_t> queuedFrames, maxQueuedFrames;
+        std::atomic<size_t> queuedBytes, maxQueuedBytes;
+        std::atomic<uint64_t> addedFrames, duplicatedFrames, droppedFrames, staticFrames, unwrittenFrames, motionSkippedFrames;
+        std::atomic<uint64_t> compressedFrames, compressionSavedBytes, spilledFrames;
+        std::atomic<uint64_t> writtenFrames, writtenBytes;
+        std::array<std::atomic<uint64_t>, ofxFFmpegRecorderStats::WriteLatencyBucketCount> writeLatencyHistogram;
+        std::atomic<uint64_t> encodedFrames;
+        std::atomic<float> encoderFps, encoderSpeed;
+    };
+
     std::string m_FFmpegPath, m_OutputPath;
+
+    /**
+     * @brief Probed lazily by getCapabilities(), and reset when the ffmpeg path changes. m_CapabilitiesProbe is the probe that
+     * probeCapabilities() started for m_CapabilitiesProbePath, its result is only used if the path is still the same.
+     */
+    std::shared_ptr<const ofxFFmpegCapabilities> m_Capabilities;
+    std::future<std::shared_ptr<const ofxFFmpegCapabilities>> m_CapabilitiesProbe;
+    std::string m_CapabilitiesProbePath;
     bool m_IsRecordVideo, m_IsRecordAudio;
 
     /**
@@ -275,11 +1054,22 @@ private:
     bool m_IsPaused;
 
     glm::vec2 m_VideoSize;
-    unsigned int m_BitRate, m_AddedVideoFrames, m_AddedAudioFrames;
+    unsigned int m_BitRate;
+
+    /**
+     * @brief This is atomic because getRecordedDuration() can be called from any thread.
+     */
+    std::atomic<unsigned int> m_AddedVideoFrames;
+    unsigned int m_AddedAudioFrames;
 
     float m_Fps,
-          m_CaptureDuration,
-          m_TotalPauseDuration;
+          m_CaptureDuration;
+
+    /**
+     * @brief In seconds. This is a double because the motion trigger sets it from the time since the recording started, and a float
+     * loses the precision that the pacing needs after a long recording.
+     */
+    double m_TotalPauseDuration;
 
     int m_bufferSize;
     int m_sampleRate;
@@ -312,22 +1102,463 @@ private:
     std::vector<std::string> m_AdditionalInputArguments, m_AdditionalOutputArguments;
 
     std::thread m_Thread;
-    LockFreeQueue<ofPixels *> m_Frames;
+    LockFreeQueue<std::shared_ptr<ofPixels>> m_Frames;
+
+    /**
+     * @brief How many times each buffer is in m_Frames and the bytes it was counted with. The duplicates and the static frames share one
+     * buffer, so its bytes are counted in the stats once, and a spilled frame is read or discarded once.
+     */
+    struct QueuedBuffer {
+        size_t count = 0;
+        size_t bytes = 0;
+    };
+
+    std::mutex m_QueuedBuffersMutex;
+    std::unordered_map<const ofPixels *, QueuedBuffer> m_QueuedBuffers;
+    std::shared_ptr<ofxFFmpegFramePool> m_FramePool;
     LockFreeQueue<ofSoundBuffer *> m_Buffers;
 
     std::string mPixFmt = "rgb24";
 
+    /**
+     * @brief The number of frames the writer thread has written to ffmpeg. This is only accessed from the writer thread.
+     */
+    unsigned int m_WrittenVideoFrames;
+
+    std::mutex m_LiveThumbnailMutex;
+    std::vector<LiveThumbnail> m_LiveThumbnails;
+    std::atomic<bool> m_HasLiveThumbnails;
+
+    /**
+     * @brief The thread that encodes the live thumbnails and the frames that wait for it. The thread is started by the writer when the
+     * first thumbnail is taken, and it runs until joinLiveThumbnails(). These are guarded by m_LiveThumbnailMutex.
+     */
+    std::condition_variable m_LiveThumbnailCondition;
+    std::deque<LiveThumbnailJob> m_LiveThumbnailJobs;
+    std::thread m_LiveThumbnailThread;
+    bool m_IsLiveThumbnailRunning;
+
+    /**
+     * @brief m_FrameSink receives the frames first and its write latency is reported in the stats, m_FrameSinks are the additional
+     * sinks added with addFrameSink().
+     */
+    std::shared_ptr<ofxFFmpegFrameSink> m_FrameSink;
+    std::vector<std::shared_ptr<ofxFFmpegFrameSink>> m_FrameSinks;
+
+    /**
+     * @brief The writer thread runs while this is true. When it is set to false, the writer thread writes the remaining frames and
+     * exits unless m_IsCancelled is also true.
+     */
+    std::atomic<bool> m_IsCustomRecording, m_IsCancelled;
+
+    /**
+     * @brief m_WriterPool is the pool of the next recording, m_SessionWriterPool is the pool that the current recording was added to.
+     */
+    std::shared_ptr<ofxFFmpegWriterPool> m_WriterPool, m_SessionWriterPool;
+    bool m_IsInWriterPool;
+
+    /**
+     * @brief The frame that a writer pool thread is writing, and how much of it is written. The write is continued the next time the
+     * pool services this recorder if the pipe was full.
+     */
+    std::shared_ptr<ofPixels> m_PooledFrame;
+    size_t m_PooledFrameOffset;
+    HighResClock m_PooledWriteStart;
+
+    std::vector<int> m_WriterThreadAffinity, m_EncoderCpuSet;
+    int m_WriterThreadPriority, m_EncoderNiceLevel;
+    unsigned int m_EncoderThreads;
+
+    ofxFFmpegStreamSettings m_StreamSettings;
+
+    bool m_IsFragmentedOutput;
+    float m_FragmentDuration;
+
+    float m_TimeScale, m_TimelapseInterval;
+
+    bool m_IsOffline;
+    size_t m_OfflineMaxQueuedFrames;
+    size_t m_ChunkedProcessCount, m_ChunkFrames;
+
+    ofxFFmpegLadderSettings m_LadderSettings;
+    bool m_IsLadderRecording;
+
+    /**
+     * @brief The offline mode waits on this when the queue is full, and the writer notifies it after each frame.
+     */
+    std::mutex m_QueueSpaceMutex;
+    std::condition_variable m_QueueSpaceCondition;
+
+    /**
+     * @brief The frames of submitFrame() that wait for the frames before them, and the sequence number of the next frame to queue. In
+     * the offline mode the producers wait on m_SubmitCondition while m_SubmittedFrames is full.
+     */
+    std::mutex m_SubmitMutex;
+    std::condition_variable m_SubmitCondition;
+    std::map<uint64_t, std::shared_ptr<ofPixels>> m_SubmittedFrames;
+    uint64_t m_NextSequence;
+    size_t m_MaxReorderedFrames;
+
+    /**
+     * @brief The last frame that was queued by addFrame(). This is only kept if m_IsSkippingStaticFrames is true.
+     */
+    bool m_IsSkippingStaticFrames;
+    std::shared_ptr<ofPixels> m_LastFrame;
+
+    /**
+     * @brief The setting of setSkippingStaticFrames(). The recording uses m_RecordCommand.isVariableFrameRate, and m_UnwrittenFrames
+     * counts the repeats since the last frame that was written in that mode.
+     */
+    bool m_IsVariableFrameRate;
+    size_t m_UnwrittenFrames;
+
+    struct PreRollFrame {
+        std::shared_ptr<ofPixels> frame;
+        double time;
+    };
+
+    float m_MotionThreshold, m_MotionPreRoll, m_MotionPostRoll;
+    size_t m_MotionRowStep;
+
+    /**
+     * @brief The sampled rows of the previous frame, and the frames that are kept for the pre-roll while there is no motion.
+     */
+    std::vector<unsigned char> m_MotionReference;
+    std::deque<PreRollFrame> m_PreRollFrames;
+    float m_MotionLevel;
+    bool m_IsMotionActive;
+    double m_LastMotionTime;
+    uint64_t m_MotionFrameCount;
+
+    /**
+     * @brief The frames of the pts that were left out of the video by the motion trigger in the offline mode.
+     */
+    int64_t m_MotionPtsOffset;
+
+    bool m_IsCompressingQueuedFrames;
+    size_t m_CompressionThreshold;
+
+    /**
+     * @brief The frames that wait for the compression thread, and the state of every frame that was handed to it until the writer
+     * reaches the frame.
+     */
+    std::mutex m_CompressionMutex;
+    std::condition_variable m_CompressionCondition;
+    std::deque<std::shared_ptr<ofPixels>> m_CompressionJobs;
+    std::unordered_map<const ofPixels *, CompressedFrame> m_CompressedFrames;
+    std::thread m_CompressionThread;
+    bool m_IsCompressionRunning;
+
+    size_t m_QueueMemoryBudget, m_SpillFileSize;
+    std::string m_SpillPath;
+    bool m_IsSpillFileFailed;
+
+    /**
+     * @brief The frames over the memory budget. They are queued in m_Frames as unallocated ofPixels that are filled from this file when
+     * the writer reaches them.
+     */
+    ofxFFmpegSpillFile m_SpillFile;
+    ofxFFmpegAdaptiveSettings m_AdaptiveSettings;
+    std::atomic<size_t> m_AdaptiveLevel;
+
+    /**
+     * @brief 1 if the encoder is behind, -1 if it keeps up and 0 otherwise, and since when. These are only accessed by the writer thread.
+     */
+    int m_AdaptiveLoad;
+    HighResClock m_AdaptiveLoadStart, m_AdaptiveLevelStart;
+
+    mutable std::mutex m_SegmentMutex;
+    std::vector<std::string> m_SegmentPaths;
+
+    CustomRecordCommand m_RecordCommand;
+
+    /**
+     * @brief The threads that wait for the ffmpeg processes of the previous adaptive segments to finish, so the writer keeps writing
+     * the next segment meanwhile. They are started by the writer thread and joined in stopCustom().
+     */
+    std::vector<std::thread> m_SegmentClosers;
+
+    StatCounters m_Stats;
+
+    /**
+     * @brief ffmpeg writes its progress to this pipe, and m_ProgressThread reads it to update the encoder stats. The write end is
+     * inherited by the ffmpeg process and closed in this process as soon as ffmpeg is started.
+     */
+    int m_ProgressPipe[2];
+    std::thread m_ProgressThread;
+
+    /**
+     * @brief Increased for each ffmpeg process, so the progress of a segment that is still finishing does not overwrite the stats of
+     * the next one.
+     */
+    std::atomic<uint64_t> m_ProgressGeneration;
+
+    glm::vec2 m_PreviewSize;
+    float m_PreviewFps;
+
+    /**
+     * @brief ffmpeg writes the preview frames of record() to this pipe, and m_PreviewThread swaps each complete frame into
+     * m_PreviewPixels.
+     */
+    int m_PreviewPipe[2];
+    std::thread m_PreviewThread;
+    std::mutex m_PreviewMutex;
+    ofPixels m_PreviewPixels;
+    std::atomic<uint64_t> m_PreviewFrameCount;
+    uint64_t m_LastPreviewFrame;
+
+    bool m_IsWritingKeyframeIndex;
+
+    /**
+     * @brief The framecrc output of the tee muxer writes a line for each packet to this pipe, and m_KeyframeIndexThread appends them to
+     * m_KeyframeIndex. Each adaptive segment has its own index.
+     */
+    int m_KeyframeIndexPipe[2];
+    std::thread m_KeyframeIndexThread;
+    std::shared_ptr<ofxFFmpegKeyframeIndex> m_KeyframeIndex;
+
 private:
     /**
      * @brief Checks if the current default devices are still available. If they are not, gets the first available device for both audio and video.
      */
     void determineDefaultDevices();
 
+    /**
+     * @brief Returns the value for the -vf argument that scales and crops a thumbnail, or an empty string if neither is needed.
+     */
+    std::string getThumbnailFilter(glm::vec2 size, const ofRectangle &crop) const;
+
+    /**
+     * @brief Returns the output path of the thumbnail at the given index for saveThumbnails().
+     */
+    std::string getThumbnailPath(const std::string &outputPattern, size_t index) const;
+
+    /**
+     * @brief Queues the width x height region of pixels at x, y as many times as the pacing needs. The region is the whole frame
+     * when it is added with addFrame(pixels).
+     */
+    size_t addFrameRegion(const ofPixels &pixels, size_t x, size_t y, size_t width, size_t height, double pts = -1,
+                          const std::shared_ptr<ofPixels> &ownedFrame = nullptr);
+
+    /**
+     * @brief Starts the writer thread, or adds the recorder to the writer pool, when the first frame is added.
+     */
+    void startWriter();
+
+    /**
+     * @brief Queues the submitted frames that are next in sequence. If force is true, the frames after a gap are also queued. This
+     * must be called with m_SubmitMutex locked.
+     */
+    void queueSubmittedFrames(bool force);
+
+    /**
+     * @brief Blocks the offline mode until the queue has room for another frame, or the recording is stopped.
+     */
+    void waitForQueueSpace();
+
+    /**
+     * @brief Returns the image paths of encodeImageSequence() in order.
+     */
+    std::vector<std::string> getImageSequencePaths(const std::string &source, size_t startNumber) const;
+
+    /**
+     * @brief Returns the capabilities if they are known without running the binary: from a finished probeCapabilities(), from memory or
+     * from the cache file. Returns nullptr otherwise.
+     */
+    std::shared_ptr<const ofxFFmpegCapabilities> getKnownCapabilities();
+
+    /**
+     * @brief Returns the encoder for the codec: the codec itself, or the fastest encoder if it is a family. Returns an empty string if the
+     * binary does not support it, and the codec if the capabilities are null or the binary cannot be probed.
+     */
+    std::string findEncoder(const std::shared_ptr<const ofxFFmpegCapabilities> &capabilities, const std::string &codec) const;
+
+    /**
+     * @brief Returns true if the settings allow the variable frame rate mode of setSkippingStaticFrames().
+     */
+    bool canUseVariableFrameRate() const;
+
+    /**
+     * @brief Checks the codec of setVideoCodec() when a recording starts, which probes the binary if it is not probed yet.
+     */
+    bool checkVideoCodec();
+
+    /**
+     * @brief Moves the pacing of a real time recording so the frames that are already added end now under the current time scale.
+     * Called when the time scale or the timelapse interval changes during a recording.
+     */
+    void rebasePacing();
+
+    /**
+     * @brief Updates the motion trigger with the frame. If the motion just started, the pre-roll frames are queued, the pacing is
+     * moved to the end of them and isMotionStart is set to true, so the caller queues this frame even if the pacing is a little short.
+     * @return Returns true if the frame must be recorded.
+     */
+    bool updateMotionTrigger(const ofPixels &pixels, size_t x, size_t y, size_t width, size_t height, double pts, bool &isMotionStart);
+
+    /**
+     * @brief Clears the reference frame, the pre-roll and the motion state. The offset of the time that was left out is kept.
+     */
+    void resetMotionTrigger();
+
+    /**
+     * @brief Hands a frame that is about to be queued to the compression thread, and starts the thread if it is not running.
+     */
+    void compressFrame(const std::shared_ptr<ofPixels> &frame);
+    void processCompression();
+    void stopCompression();
+
+    /**
+     * @brief Called by the writer before a frame is written. Decompresses the frame if it was compressed, or reads it from the spill
+     * file if it was spilled, otherwise makes sure that the compression thread leaves it alone.
+     */
+    void restoreFrame(ofPixels &pixels);
+
+    /**
+     * @brief Returns true if a frame of the given size would go over the memory budget of the queue, and opens the spill file if it is
+     * not open yet.
+     */
+    bool shouldSpillFrame(size_t bytes);
+
+    /**
+     * @brief Forgets a frame that is discarded without being written. Called once for every buffer, when its last copy in the queue is
+     * discarded.
+     */
+    void discardFrame(const ofPixels &pixels);
+
     /**
      * @brief Runs in parallele and writes the stored frames/buffers to ffmpeg
      */
     void processFrame();
     void processBuffer();
+    void writeFrame(const std::shared_ptr<ofPixels> &pixels);
+
+    /**
+     * @brief Starts ffmpeg for the custom recording from m_RecordCommand with the given adaptive level, and sets m_CustomRecordingFile
+     * and m_FrameSink.
+     */
+    void openCustomRecordPipe(const std::string &outputPath, size_t level);
+
+    /**
+     * @brief Returns the ffmpeg arguments of the custom recording with the given adaptive level, except for the output path.
+     */
+    std::vector<std::string> getCustomRecordArguments(const std::string &outputPath, bool includeMuxerOptions = true, size_t level = 0) const;
+
+    /**
+     * @brief Returns the command of a custom recording to outputPath with the current settings.
+     */
+    CustomRecordCommand getCustomRecordCommand(const std::string &outputPath) const;
+
+    /**
+     * @brief Closes the ffmpeg process of the current adaptive segment on a background thread, together with its readers.
+     */
+    void closeSegment();
+    void joinSegmentClosers();
+
+    /**
+     * @brief Returns the options of the output file's muxer as name and value pairs.
+     */
+    std::vector<std::pair<std::string, std::string>> getMuxerOptions(const std::string &outputPath) const;
+
+    /**
+     * @brief Starts the ffmpeg process of the rendition ladder. Used by startCustomRecord() and startCustomStreaming().
+     */
+    bool startLadderRecord();
+
+    /**
+     * @brief Returns the ffmpeg arguments of the rendition ladder, including the output.
+     */
+    std::vector<std::string> getLadderArguments() const;
+
+    /**
+     * @brief Called by the writer thread after a frame is written. Switches the adaptive encoding level if needed.
+     */
+    void updateAdaptiveLevel();
+    void finishFrame(const std::shared_ptr<ofPixels> &pixels, size_t written, const HighResClock &writeStart);
+
+    /**
+     * @brief Used by the writer pool. hasPooledFrame() returns true if there are frames to write. writePooledFrame() writes one frame,
+     * and if fd is not negative it writes to it without blocking instead of using the sink. It returns false if the pipe is full.
+     */
+    bool hasPooledFrame() const;
+    bool writePooledFrame(int fd);
+
+    /**
+     * @brief Removes this recorder from the writer pool and writes the rest of the frames on the calling thread unless cancelled is true.
+     */
+    void leaveWriterPool(bool cancelled);
+    void writeBuffer(ofSoundBuffer *buffer);
     void joinThread();
 
+    /**
+     * @brief Waits for the taken live thumbnails to be encoded, stops their thread and discards the requests that were not reached. This
+     * is called after the writer thread and the writer pool are done with the recording, so no thumbnail can be taken after it.
+     */
+    void joinLiveThumbnails();
+
+    /**
+     * @brief Applies m_WriterThreadAffinity and m_WriterThreadPriority to the calling thread.
+     */
+    void applyWriterThreadSettings();
+
+    /**
+     * @brief Returns the commands that ffmpeg is started with to apply m_EncoderCpuSet and m_EncoderNiceLevel, or an empty string.
+     */
+    std::string getEncoderCommandPrefix() const;
+
+    /**
+     * @brief Stops the writer thread, closes the sinks and ffmpeg. If cancelled is true, the frames that are not yet written are discarded.
+     */
+    void stopCustom(bool cancelled);
+
+    /**
+     * @brief Called by the writer thread after a frame is written. If any live thumbnail is requested for the frame, the pixels are
+     * queued for the thread that encodes them.
+     */
+    void takeLiveThumbnails(const std::shared_ptr<ofPixels> &pixels);
+    void processLiveThumbnails();
+
+    void resetStats();
+    void addQueuedFrame(size_t bytes);
+    void removeQueuedFrame(size_t bytes);
+
+    /**
+     * @brief Counts the buffer as queued once more. Returns bytes if the buffer was not in the queue yet, and 0 otherwise.
+     */
+    size_t retainQueuedBuffer(const ofPixels &pixels, size_t bytes);
+
+    /**
+     * @brief Returns the bytes that the buffer was counted with if this was its last copy in the queue, and 0 otherwise.
+     */
+    size_t releaseQueuedBuffer(const ofPixels &pixels);
+    void addWrite(size_t bytes, const HighResClock &start);
+
+    /**
+     * @brief Adds the "-progress" argument to args and creates the pipe that ffmpeg writes its progress to. startProgressReader()
+     * must be called after ffmpeg is started.
+     */
+    void openProgressPipe(std::vector<std::string> &args);
+    void startProgressReader();
+    void processProgress(int fd, uint64_t generation);
+    void joinProgressReader();
+
+    /**
+     * @brief Adds the preview output to args and creates its pipe if the preview is enabled. startPreviewReader() must be called after
+     * ffmpeg is started.
+     */
+    void openPreviewPipe(std::vector<std::string> &args);
+    void startPreviewReader();
+    void processPreview();
+    void joinPreviewReader();
+
+    /**
+     * @brief Creates the keyframe index of outputPath and its pipe if the index is enabled. startKeyframeIndexReader() must be called
+     * after ffmpeg is started.
+     * @return Returns true if the output has to go through the tee muxer.
+     */
+    bool openKeyframeIndexPipe(const std::string &outputPath);
+    void startKeyframeIndexReader();
+    void processKeyframeIndex(int fd, std::shared_ptr<ofxFFmpegKeyframeIndex> index, float fps);
+    void joinKeyframeIndexReader();
+
 };
@@ -0,0 +1,189 @@
+#include "ofxFFmpegSpillFile.h"
+// openFrameworks
+#include "ofLog.h"
+
+#include "ofxFFmpegPixelUtils.h"
+
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+// Logging macros
+#define LOG_ERROR(message) ofLogError("") << __FUNCTION__ << ":" << __LINE__ << ": " << message
+
+ofxFFmpegSpillFile::ofxFFmpegSpillFile()
+    : m_FileDescriptor(-1)
+    , m_Data(nullptr)
+    , m_Capacity(0)
+    , m_SlotSize(0)
+    , m_SlotCount(0)
+    , m_PushCount(0)
+    , m_PopCount(0)
+    , m_FrameLength(0)
+{
+
+}
+
+ofxFFmpegSpillFile::~ofxFFmpegSpillFile()
+{
+    close();
+}
+
+bool ofxFFmpegSpillFile::open(const std::string &path, size_t capacity)
+{
+    close();
+
+#if defined(_WIN32)
+    LOG_ERROR("Spilling the queued frames to a file is not supported on Windows.");
+    return false;
+#else
+    m_FileDescriptor = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (m_FileDescriptor < 0) {
+        LOG_ERROR("Cannot create the spill file " + path + ": " + strerror(errno));
+        return false;
+    }
+
+    // The file is sparse, the disk space is only used by the slots that are written.
+    if (ftruncate(m_FileDescriptor, capacity) != 0) {
+        LOG_ERROR("Cannot resize the spill file " + path + ": " + strerror(errno));
+        ::close(m_FileDescriptor);
+        m_FileDescriptor = -1;
+        unlink(path.c_str());
+        return false;
+    }
+
+    void *data = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_FileDescriptor, 0);
+    unlink(path.c_str());
+    if (data == MAP_FAILED) {
+        LOG_ERROR("Cannot map the spill file " + path + ": " + strerror(errno));
+        ::close(m_FileDescriptor);
+        m_FileDescriptor = -1;
+        return false;
+    }
+
+    m_Data = static_cast<unsigned char *>(data);
+    m_Capacity = capacity;
+    return true;
+#endif
+}
+
+void ofxFFmpegSpillFile::close()
+{
+#if !defined(_WIN32)
+    if (m_Data) {
+        munmap(m_Data, m_Capacity);
+    }
+
+    if (m_FileDescriptor >= 0) {
+        ::close(m_FileDescriptor);
+    }
+#endif
+
+    m_Data = nullptr;
+    m_FileDescriptor = -1;
+    m_Capacity = 0;
+    m_SlotSize = 0;
+    m_SlotCount = 0;
+    m_PushCount = 0;
+    m_PopCount = 0;
+    m_FrameLength = 0;
+}
+
+bool ofxFFmpegSpillFile::isOpen() const
+{
+    return m_Data != nullptr;
+}
+
+bool ofxFFmpegSpillFile::push(const ofPixels &source, size_t x, size_t y, size_t width, size_t height)
+{
+    if (m_Data == nullptr || source.getTotalBytes() != source.getBytesStride() * source.getHeight()) {
+        return false;
+    }
+
+    const size_t length = width * height * source.getBytesPerPixel();
+    if (m_SlotSize == 0) {
+#if !defined(_WIN32)
+        // The slots are aligned to the pages so that the pages of a slot can be released on their own.
+        const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        m_SlotSize = (sizeof(SlotHeader) + length + pageSize - 1) / pageSize * pageSize;
+        m_SlotCount = m_Capacity / m_SlotSize;
+        m_FrameLength = length;
+#endif
+    }
+
+    if (length != m_FrameLength || m_PushCount - m_PopCount >= m_SlotCount) {
+        return false;
+    }
+
+    unsigned char *slot = getSlot(m_PushCount);
+    SlotHeader header;
+    header.width = static_cast<uint32_t>(width);
+    header.height = static_cast<uint32_t>(height);
+    header.format = static_cast<uint32_t>(source.getPixelFormat());
+    header.length = static_cast<uint32_t>(length);
+    memcpy(slot, &header, sizeof(SlotHeader));
+
+    ofxFFmpegCopyRegion(source, x, y, width, height, slot + sizeof(SlotHeader));
+
+    // The dirty pages stay in the page cache and are written back by the kernel, they are only unmapped from this process.
+    releaseSlot(slot);
+    m_PushCount.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+bool ofxFFmpegSpillFile::pop(ofPixels &pixels)
+{
+    if (m_PopCount.load(std::memory_order_relaxed) == m_PushCount.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    unsigned char *slot = getSlot(m_PopCount);
+    SlotHeader header;
+    memcpy(&header, slot, sizeof(SlotHeader));
+    pixels.allocate(header.width, header.height, static_cast<ofPixelFormat>(header.format));
+    memcpy(pixels.getData(), slot + sizeof(SlotHeader), std::min<size_t>(header.length, pixels.getTotalBytes()));
+
+    releaseSlot(slot);
+    m_PopCount.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+size_t ofxFFmpegSpillFile::discard()
+{
+    if (m_PopCount.load(std::memory_order_relaxed) == m_PushCount.load(std::memory_order_acquire)) {
+        return 0;
+    }
+
+    unsigned char *slot = getSlot(m_PopCount);
+    releaseSlot(slot);
+    m_PopCount.fetch_add(1, std::memory_order_release);
+    return m_FrameLength;
+}
+
+size_t ofxFFmpegSpillFile::getCount() const
+{
+    return m_PushCount.load(std::memory_order_acquire) - m_PopCount.load(std::memory_order_acquire);
+}
+
+size_t ofxFFmpegSpillFile::getBytes() const
+{
+    return getCount() * m_FrameLength;
+}
+
+unsigned char *ofxFFmpegSpillFile::getSlot(uint64_t index) const
+{
+    return m_Data + (index % m_SlotCount) * m_SlotSize;
+}
+
+void ofxFFmpegSpillFile::releaseSlot(unsigned char *slot)
+{
+#if !defined(_WIN32)
+    madvise(slot, m_SlotSize, MADV_DONTNEED);
+#endif
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "ofPixels.h"
+
+#include <atomic>
+#include <string>
+
+/**
+ * @brief A memory mapped file that holds the queued frames that do not fit in the memory budget of ofxFFmpegRecorder. The file is a
+ * ring of fixed size slots, one frame per slot, that is filled by the thread that adds the frames and drained in the same order by
+ * the writer thread. The pages of a slot are given back to the kernel as soon as it is filled and again when it is read, so the slots
+ * do not count towards the resident memory of the application. The file is deleted as soon as it is mapped.
+ * This is not supported on Windows.
+ */
+class ofxFFmpegSpillFile
+{
+public:
+    ofxFFmpegSpillFile();
+    ~ofxFFmpegSpillFile();
+
+    /**
+     * @brief Creates the file. The size of the slots is set by the first frame that is pushed.
+     * @param path
+     * @param capacity The size of the file in bytes.
+     * @return Returns false if the file cannot be created or mapped.
+     */
+    bool open(const std::string &path, size_t capacity);
+
+    /**
+     * @brief Unmaps the file. The frames that were not popped are lost.
+     */
+    void close();
+
+    bool isOpen() const;
+
+    /**
+     * @brief Copies the width x height region at x, y of source into the next slot. source must have a single plane.
+     * @return Returns false if the file is full or if the frame does not have the size of the slots.
+     */
+    bool push(const ofPixels &source, size_t x, size_t y, size_t width, size_t height);
+
+    /**
+     * @brief Copies the oldest frame into pixels and frees its slot.
+     * @return Returns false if the file is empty.
+     */
+    bool pop(ofPixels &pixels);
+
+    /**
+     * @brief Frees the slot of the oldest frame without reading it, and returns the size of the frame.
+     */
+    size_t discard();
+
+    /**
+     * @brief Returns the number of frames that are in the file.
+     */
+    size_t getCount() const;
+
+    /**
+     * @brief Returns the number of bytes of the frames that are in the file.
+     */
+    size_t getBytes() const;
+
+private:
+    struct SlotHeader {
+        uint32_t width, height, format;
+        uint32_t length;
+    };
+
+    int m_FileDescriptor;
+    unsigned char *m_Data;
+    size_t m_Capacity, m_SlotSize, m_SlotCount;
+
+    /**
+     * @brief The number of frames that were pushed and popped. Only the producer changes m_PushCount and only the consumer changes
+     * m_PopCount.
+     */
+    std::atomic<uint64_t> m_PushCount, m_PopCount;
+    std::atomic<size_t> m_FrameLength;
+
+private:
+    unsigned char *getSlot(uint64_t index) const;
+    void releaseSlot(unsigned char *slot);
+};
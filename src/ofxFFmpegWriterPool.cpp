@@ -0,0 +1,219 @@
+#include "ofxFFmpegWriterPool.h"
+#include "ofxFFmpegRecorder.h"
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+ofxFFmpegWriterPool::ofxFFmpegWriterPool(size_t threadCount)
+    : m_IsRunning(true)
+    , m_NextEntry(0)
+    , m_IdleCount(0)
+    , m_EpollFd(-1)
+    , m_EventFd(-1)
+{
+#if defined(__linux__)
+    m_EpollFd = epoll_create1(EPOLL_CLOEXEC);
+    m_EventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (m_EpollFd >= 0 && m_EventFd >= 0) {
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = m_EventFd;
+        epoll_ctl(m_EpollFd, EPOLL_CTL_ADD, m_EventFd, &event);
+    }
+#endif
+
+    for (size_t i = 0; i < std::max<size_t>(threadCount, 1); i++) {
+        m_Threads.push_back(std::thread(&ofxFFmpegWriterPool::process, this));
+    }
+}
+
+ofxFFmpegWriterPool::~ofxFFmpegWriterPool()
+{
+    m_IsRunning = false;
+    notify();
+    m_Condition.notify_all();
+    for (std::thread &thread : m_Threads) {
+        thread.join();
+    }
+
+#if defined(__linux__)
+    if (m_EventFd >= 0) {
+        close(m_EventFd);
+    }
+
+    if (m_EpollFd >= 0) {
+        close(m_EpollFd);
+    }
+#endif
+}
+
+size_t ofxFFmpegWriterPool::getThreadCount() const
+{
+    return m_Threads.size();
+}
+
+void ofxFFmpegWriterPool::add(ofxFFmpegRecorder *recorder, int fd)
+{
+    std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+    entry->recorder = recorder;
+    entry->fd = -1;
+    entry->isBusy = false;
+    entry->isBlocked = false;
+
+#if defined(__linux__)
+    if (fd >= 0 && m_EpollFd >= 0) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+        // Edge triggered, the threads are woken up once when a full pipe becomes writable.
+        epoll_event event;
+        event.events = EPOLLOUT | EPOLLET;
+        event.data.fd = fd;
+        if (epoll_ctl(m_EpollFd, EPOLL_CTL_ADD, fd, &event) == 0) {
+            entry->fd = fd;
+        }
+        else {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+        }
+    }
+#endif
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Entries.push_back(entry);
+}
+
+void ofxFFmpegWriterPool::remove(ofxFFmpegRecorder *recorder)
+{
+    std::shared_ptr<Entry> entry;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        for (auto it = m_Entries.begin(); it != m_Entries.end(); ++it) {
+            if ((*it)->recorder == recorder) {
+                entry = *it;
+                m_Entries.erase(it);
+                break;
+            }
+        }
+    }
+
+    if (entry == nullptr) {
+        return;
+    }
+
+    // The entries are only acquired while the mutex is locked, so nothing can start writing the frames of the recorder after this.
+    while (entry->isBusy) {
+        std::this_thread::yield();
+    }
+
+#if defined(__linux__)
+    if (entry->fd >= 0) {
+        epoll_ctl(m_EpollFd, EPOLL_CTL_DEL, entry->fd, nullptr);
+        fcntl(entry->fd, F_SETFL, fcntl(entry->fd, F_GETFL) & ~O_NONBLOCK);
+    }
+#endif
+}
+
+void ofxFFmpegWriterPool::notify()
+{
+    if (m_IdleCount == 0 && m_IsRunning) {
+        return;
+    }
+
+#if defined(__linux__)
+    if (m_EventFd >= 0) {
+        const uint64_t value = 1;
+        ssize_t result = write(m_EventFd, &value, sizeof(value));
+        (void)result;
+        return;
+    }
+#endif
+
+    m_Condition.notify_one();
+}
+
+void ofxFFmpegWriterPool::process()
+{
+    while (m_IsRunning) {
+        std::shared_ptr<Entry> entry = acquire();
+        if (entry == nullptr) {
+            wait();
+            continue;
+        }
+
+        // isBlocked is set before the write so that an epoll event that arrives while writing is not lost.
+        entry->isBlocked = entry->fd >= 0;
+        const bool isWritten = entry->recorder->writePooledFrame(entry->fd);
+        if (isWritten) {
+            entry->isBlocked = false;
+        }
+
+        entry->isBusy = false;
+    }
+}
+
+std::shared_ptr<ofxFFmpegWriterPool::Entry> ofxFFmpegWriterPool::acquire()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    for (size_t i = 0; i < m_Entries.size(); i++) {
+        // Round robin so that every recorder gets its turn.
+        const size_t index = (m_NextEntry + i) % m_Entries.size();
+        std::shared_ptr<Entry> &entry = m_Entries[index];
+        if (entry->isBusy || entry->isBlocked || entry->recorder->hasPooledFrame() == false) {
+            continue;
+        }
+
+        entry->isBusy = true;
+        m_NextEntry = index + 1;
+        return entry;
+    }
+
+    return nullptr;
+}
+
+void ofxFFmpegWriterPool::wait()
+{
+    m_IdleCount++;
+
+#if defined(__linux__)
+    if (m_EpollFd >= 0 && m_EventFd >= 0) {
+        epoll_event events[16];
+        const int count = epoll_wait(m_EpollFd, events, 16, 10);
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.fd == m_EventFd) {
+                uint64_t value = 0;
+                ssize_t result = read(m_EventFd, &value, sizeof(value));
+                (void)result;
+                continue;
+            }
+
+            for (std::shared_ptr<Entry> &entry : m_Entries) {
+                if (entry->fd == events[i].data.fd) {
+                    entry->isBlocked = false;
+                }
+            }
+        }
+
+        // An event can be missed if the pipe became writable before the write returned EAGAIN, so retry the blocked pipes on timeout.
+        if (count == 0) {
+            for (std::shared_ptr<Entry> &entry : m_Entries) {
+                entry->isBlocked = false;
+            }
+        }
+
+        m_IdleCount--;
+        return;
+    }
+#endif
+
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_Condition.wait_for(lock, std::chrono::milliseconds(1));
+    m_IdleCount--;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <vector>
+#include <memory>
+
+class ofxFFmpegRecorder;
+
+/**
+ * @brief Writes the queued frames of many recorders on a fixed number of threads instead of one writer thread per recorder. The
+ * recorders are serviced in turns, one frame at a time, so a recorder with a long queue cannot starve the others. On Linux the ffmpeg
+ * pipes are written without blocking and a thread that has nothing to write waits with epoll until a pipe is writable or a new frame
+ * is added. On other platforms the frames are written with blocking writes.
+ * **Example Usage**
+ * @code
+ *     std::shared_ptr<ofxFFmpegWriterPool> pool = std::make_shared<ofxFFmpegWriterPool>(4);
+ *     for (ofxFFmpegRecorder &recorder : recorders) {
+ *         recorder.setWriterPool(pool);
+ *     }
+ * @endcode
+ */
+class ofxFFmpegWriterPool
+{
+public:
+    ofxFFmpegWriterPool(size_t threadCount = 2);
+    ~ofxFFmpegWriterPool();
+
+    size_t getThreadCount() const;
+
+private:
+    friend class ofxFFmpegRecorder;
+
+    struct Entry {
+        ofxFFmpegRecorder *recorder;
+        int fd;
+        std::atomic<bool> isBusy, isBlocked;
+    };
+
+    std::vector<std::thread> m_Threads;
+    std::atomic<bool> m_IsRunning;
+
+    std::mutex m_Mutex;
+    std::vector<std::shared_ptr<Entry>> m_Entries;
+    size_t m_NextEntry;
+
+    /**
+     * @brief The number of threads that are waiting for work. New frames only wake up the threads if this is not zero.
+     */
+    std::atomic<size_t> m_IdleCount;
+
+    int m_EpollFd, m_EventFd;
+    std::condition_variable m_Condition;
+
+private:
+    /**
+     * @brief Adds a recorder whose frames will be written by the pool. If fd is not negative, it is switched to non-blocking mode.
+     */
+    void add(ofxFFmpegRecorder *recorder, int fd);
+
+    /**
+     * @brief Removes the recorder and waits until no thread is writing its frames. If fd was added, it is switched back to blocking mode.
+     */
+    void remove(ofxFFmpegRecorder *recorder);
+
+    /**
+     * @brief Called by the recorder when a frame is queued.
+     */
+    void notify();
+
+    void process();
+    std::shared_ptr<Entry> acquire();
+    void wait();
+};